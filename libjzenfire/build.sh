@@ -18,6 +18,11 @@ if test ! -e $zf_lib; then
   exit 1
 fi
 
-g++ -m32 -g -c src/libjzenfire.cpp -o src/libjzenfire.o -I$zf_inc_dir -I$JAVA_HOME/include -I$JAVA_HOME/include/linux
-g++ -m32 -shared -o libjzenfire.so  src/libjzenfire.o $zf_lib -lpthread -lrt
+sources="libjzenfire analytics archive jzenfire_c merge_replay shm_ring synthetic threads throttle trace"
+objects=
 
+for src in $sources; do
+  g++ -m32 -g -c src/$src.cpp -o src/$src.o -I$zf_inc_dir -I$JAVA_HOME/include -I$JAVA_HOME/include/linux || exit 1
+  objects="$objects src/$src.o"
+done
+g++ -m32 -shared -o libjzenfire.so $objects $zf_lib -lpthread -lrt
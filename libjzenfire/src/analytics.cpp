@@ -0,0 +1,407 @@
+
+//############################################################################//
+
+/** \file analytics.cpp
+ * \brief Interval analytics over columnar tick data
+ *
+ * Intervals are found by binary search on the (sorted) timestamps, and each
+ * interval is summed with the widest kernel the CPU supports. Kernels are
+ * picked once, at first use.
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "analytics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define ANALYTICS_X86 1
+#endif
+
+using namespace std;
+
+// K E R N E L S #############################################################//
+
+/** sum(price * size) and sum(size) */
+typedef void (*volume_fn)(const double *p, const int32_t *s, size_t n, double &pv, double &v);
+/** sum(((p[i] - p[i-1]) / p[i-1])^2) for i in 1..n-1 */
+typedef double (*returns_fn)(const double *p, size_t n);
+/** sum(sign(p[i] - p[i-1]) * s[i]) for i in 1..n-1 */
+typedef double (*signed_volume_fn)(const double *p, const int32_t *s, size_t n);
+typedef void (*range_fn)(const double *p, size_t n, double &lo, double &hi);
+
+static void volume_scalar(const double *p, const int32_t *s, size_t n, double &pv, double &v) {
+    double apv = 0.0, av = 0.0;
+    for (size_t i = 0; i < n; i ++) {
+        apv += p[i] * s[i];
+        av += s[i];
+    }
+    pv = apv;
+    v = av;
+}
+
+static double returns_scalar(const double *p, size_t n) {
+    double acc = 0.0;
+    for (size_t i = 1; i < n; i ++) {
+        double r = (p[i] - p[i - 1]) / p[i - 1];
+        acc += r * r;
+    }
+    return acc;
+}
+
+static double signed_volume_scalar(const double *p, const int32_t *s, size_t n) {
+    double acc = 0.0;
+    for (size_t i = 1; i < n; i ++) {
+        if (p[i] > p[i - 1]) acc += s[i];
+        else if (p[i] < p[i - 1]) acc -= s[i];
+    }
+    return acc;
+}
+
+static void range_scalar(const double *p, size_t n, double &lo, double &hi) {
+    double l = p[0], h = p[0];
+    for (size_t i = 1; i < n; i ++) {
+        if (p[i] < l) l = p[i];
+        if (p[i] > h) h = p[i];
+    }
+    lo = l;
+    hi = h;
+}
+
+#ifdef ANALYTICS_X86
+
+__attribute__((target("sse2")))
+static double hsum_sse2(__m128d x) {
+    double t[2];
+    _mm_storeu_pd(t, x);
+    return t[0] + t[1];
+}
+
+__attribute__((target("sse2")))
+static void volume_sse2(const double *p, const int32_t *s, size_t n, double &pv, double &v) {
+    __m128d apv = _mm_setzero_pd(), av = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d sz = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *) (s + i)));
+        apv = _mm_add_pd(apv, _mm_mul_pd(_mm_loadu_pd(p + i), sz));
+        av = _mm_add_pd(av, sz);
+    }
+    double tpv, tv;
+    volume_scalar(p + i, s + i, n - i, tpv, tv);
+    pv = hsum_sse2(apv) + tpv;
+    v = hsum_sse2(av) + tv;
+}
+
+__attribute__((target("sse2")))
+static double returns_sse2(const double *p, size_t n) {
+    if (n < 2) return 0.0;
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 1;
+    for (; i + 2 <= n; i += 2) {
+        __m128d prev = _mm_loadu_pd(p + i - 1);
+        __m128d r = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(p + i), prev), prev);
+        acc = _mm_add_pd(acc, _mm_mul_pd(r, r));
+    }
+    return hsum_sse2(acc) + returns_scalar(p + i - 1, n - i + 1);
+}
+
+__attribute__((target("sse2")))
+static double signed_volume_sse2(const double *p, const int32_t *s, size_t n) {
+    if (n < 2) return 0.0;
+    __m128d acc = _mm_setzero_pd();
+    __m128d zero = _mm_setzero_pd();
+    size_t i = 1;
+    for (; i + 2 <= n; i += 2) {
+        __m128d d = _mm_sub_pd(_mm_loadu_pd(p + i), _mm_loadu_pd(p + i - 1));
+        __m128d sz = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *) (s + i)));
+        __m128d up = _mm_and_pd(_mm_cmpgt_pd(d, zero), sz);
+        __m128d down = _mm_and_pd(_mm_cmplt_pd(d, zero), sz);
+        acc = _mm_add_pd(acc, _mm_sub_pd(up, down));
+    }
+    return hsum_sse2(acc) + signed_volume_scalar(p + i - 1, s + i - 1, n - i + 1);
+}
+
+__attribute__((target("sse2")))
+static void range_sse2(const double *p, size_t n, double &lo, double &hi) {
+    if (n < 2) {
+        range_scalar(p, n, lo, hi);
+        return;
+    }
+    __m128d l = _mm_loadu_pd(p), h = l;
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(p + i);
+        l = _mm_min_pd(l, x);
+        h = _mm_max_pd(h, x);
+    }
+    double tl[2], th[2];
+    _mm_storeu_pd(tl, l);
+    _mm_storeu_pd(th, h);
+    lo = min(tl[0], tl[1]);
+    hi = max(th[0], th[1]);
+    for (; i < n; i ++) {
+        if (p[i] < lo) lo = p[i];
+        if (p[i] > hi) hi = p[i];
+    }
+}
+
+__attribute__((target("avx2")))
+static double hsum_avx2(__m256d x) {
+    double t[4];
+    _mm256_storeu_pd(t, x);
+    return (t[0] + t[1]) + (t[2] + t[3]);
+}
+
+__attribute__((target("avx2")))
+static void volume_avx2(const double *p, const int32_t *s, size_t n, double &pv, double &v) {
+    __m256d apv = _mm256_setzero_pd(), av = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d sz = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) (s + i)));
+        apv = _mm256_add_pd(apv, _mm256_mul_pd(_mm256_loadu_pd(p + i), sz));
+        av = _mm256_add_pd(av, sz);
+    }
+    double tpv, tv;
+    volume_scalar(p + i, s + i, n - i, tpv, tv);
+    pv = hsum_avx2(apv) + tpv;
+    v = hsum_avx2(av) + tv;
+}
+
+__attribute__((target("avx2")))
+static double returns_avx2(const double *p, size_t n) {
+    if (n < 2) return 0.0;
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 1;
+    for (; i + 4 <= n; i += 4) {
+        __m256d prev = _mm256_loadu_pd(p + i - 1);
+        __m256d r = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(p + i), prev), prev);
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(r, r));
+    }
+    return hsum_avx2(acc) + returns_scalar(p + i - 1, n - i + 1);
+}
+
+__attribute__((target("avx2")))
+static double signed_volume_avx2(const double *p, const int32_t *s, size_t n) {
+    if (n < 2) return 0.0;
+    __m256d acc = _mm256_setzero_pd();
+    __m256d zero = _mm256_setzero_pd();
+    size_t i = 1;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(p + i), _mm256_loadu_pd(p + i - 1));
+        __m256d sz = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) (s + i)));
+        __m256d up = _mm256_and_pd(_mm256_cmp_pd(d, zero, _CMP_GT_OQ), sz);
+        __m256d down = _mm256_and_pd(_mm256_cmp_pd(d, zero, _CMP_LT_OQ), sz);
+        acc = _mm256_add_pd(acc, _mm256_sub_pd(up, down));
+    }
+    return hsum_avx2(acc) + signed_volume_scalar(p + i - 1, s + i - 1, n - i + 1);
+}
+
+__attribute__((target("avx2")))
+static void range_avx2(const double *p, size_t n, double &lo, double &hi) {
+    if (n < 4) {
+        range_scalar(p, n, lo, hi);
+        return;
+    }
+    __m256d l = _mm256_loadu_pd(p), h = l;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(p + i);
+        l = _mm256_min_pd(l, x);
+        h = _mm256_max_pd(h, x);
+    }
+    double tl[4], th[4];
+    _mm256_storeu_pd(tl, l);
+    _mm256_storeu_pd(th, h);
+    lo = min(min(tl[0], tl[1]), min(tl[2], tl[3]));
+    hi = max(max(th[0], th[1]), max(th[2], th[3]));
+    for (; i < n; i ++) {
+        if (p[i] < lo) lo = p[i];
+        if (p[i] > hi) hi = p[i];
+    }
+}
+
+#endif
+
+struct kernels_t {
+    const char *isa;
+    volume_fn volume;
+    returns_fn returns;
+    signed_volume_fn signed_volume;
+    range_fn range;
+};
+
+static kernels_t select_kernels() {
+    kernels_t k = { "scalar", volume_scalar, returns_scalar, signed_volume_scalar, range_scalar };
+#ifdef ANALYTICS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels_t avx2 = { "avx2", volume_avx2, returns_avx2, signed_volume_avx2, range_avx2 };
+        k = avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels_t sse2 = { "sse2", volume_sse2, returns_sse2, signed_volume_sse2, range_sse2 };
+        k = sse2;
+    }
+#endif
+    return k;
+}
+
+static const kernels_t &kernels() {
+    static kernels_t k = select_kernels();
+    return k;
+}
+
+// I N T E R V A L S #########################################################//
+
+static int64_t interval_start(int64_t ts, int64_t interval) {
+    int64_t q = ts / interval;
+    if (ts % interval != 0 && ts < 0) q --;
+    return q * interval;
+}
+
+/**
+ * Calls f(begin, end, start) for every run of ticks falling in the same
+ * interval. Throws invalid_argument if the ticks are not in time order.
+ */
+template <class F>
+static void for_each_interval(const tick_columns &ticks, int64_t interval, F &f) {
+    if (interval <= 0) {
+        throw invalid_argument("interval must be positive");
+    }
+    for (size_t k = 1; k < ticks.n; k ++) {
+        if (ticks.ts[k] < ticks.ts[k - 1]) {
+            throw invalid_argument("ticks are not in time order");
+        }
+    }
+    size_t i = 0;
+    while (i < ticks.n) {
+        int64_t start = interval_start(ticks.ts[i], interval);
+        size_t end = upper_bound(ticks.ts + i, ticks.ts + ticks.n, start + interval - 1) - ticks.ts;
+        f(i, end, start);
+        i = end;
+    }
+}
+
+struct vwap_f {
+    const tick_columns &t;
+    interval_series &out;
+    vwap_f(const tick_columns &t, interval_series &out) : t(t), out(out) { }
+
+    void operator()(size_t b, size_t e, int64_t start) {
+        double pv, v;
+        kernels().volume(t.price + b, t.size + b, e - b, pv, v);
+        out.start.push_back(start);
+        out.a.push_back(v > 0.0 ? pv / v : NAN);
+        out.b.push_back(v);
+    }
+};
+
+struct vol_f {
+    const tick_columns &t;
+    interval_series &out;
+    vol_f(const tick_columns &t, interval_series &out) : t(t), out(out) { }
+
+    void operator()(size_t b, size_t e, int64_t start) {
+        out.start.push_back(start);
+        out.a.push_back(sqrt(kernels().returns(t.price + b, e - b)));
+    }
+};
+
+struct imbalance_f {
+    const tick_columns &t;
+    interval_series &out;
+    imbalance_f(const tick_columns &t, interval_series &out) : t(t), out(out) { }
+
+    void operator()(size_t b, size_t e, int64_t start) {
+        double pv, v;
+        kernels().volume(t.price + b, t.size + b, e - b, pv, v);
+        double sv = kernels().signed_volume(t.price + b, t.size + b, e - b);
+        out.start.push_back(start);
+        out.a.push_back(v > 0.0 ? sv / v : 0.0);
+    }
+};
+
+struct ohlc_f {
+    const tick_columns &t;
+    interval_series &out;
+    ohlc_f(const tick_columns &t, interval_series &out) : t(t), out(out) { }
+
+    void operator()(size_t b, size_t e, int64_t start) {
+        double lo, hi;
+        kernels().range(t.price + b, e - b, lo, hi);
+        out.start.push_back(start);
+        out.a.push_back(t.price[b]);
+        out.b.push_back(hi);
+        out.c.push_back(lo);
+        out.d.push_back(t.price[e - 1]);
+    }
+};
+
+void interval_vwap(const tick_columns &ticks, int64_t interval, interval_series &out) {
+    vwap_f f(ticks, out);
+    for_each_interval(ticks, interval, f);
+}
+
+void interval_realized_vol(const tick_columns &ticks, int64_t interval, interval_series &out) {
+    vol_f f(ticks, out);
+    for_each_interval(ticks, interval, f);
+}
+
+void interval_imbalance(const tick_columns &ticks, int64_t interval, interval_series &out) {
+    imbalance_f f(ticks, out);
+    for_each_interval(ticks, interval, f);
+}
+
+void interval_ohlc(const tick_columns &ticks, int64_t interval, interval_series &out) {
+    ohlc_f f(ticks, out);
+    for_each_interval(ticks, interval, f);
+}
+
+tick_columns select_type(const tick_columns &ticks, const int8_t *types, int type,
+    vector<int64_t> &ts, vector<double> &price, vector<int32_t> &size) {
+
+    ts.clear();
+    price.clear();
+    size.clear();
+    for (size_t i = 0; i < ticks.n; i ++) {
+        if (types[i] == type) {
+            ts.push_back(ticks.ts[i]);
+            price.push_back(ticks.price[i]);
+            size.push_back(ticks.size[i]);
+        }
+    }
+    tick_columns out;
+    out.n = ts.size();
+    out.ts = out.n > 0 ? &ts[0] : NULL;
+    out.price = out.n > 0 ? &price[0] : NULL;
+    out.size = out.n > 0 ? &size[0] : NULL;
+    return out;
+}
+
+const char *analytics_isa() {
+    return kernels().isa;
+}
+
+//############################################################################//
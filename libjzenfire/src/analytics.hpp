@@ -0,0 +1,91 @@
+
+//############################################################################//
+
+/** \file analytics.hpp
+ * \brief Interval analytics over columnar tick data
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_ANALYTICS_HPP
+#define JZENFIRE_ANALYTICS_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+/**
+ * Ticks in columns, in time order; the same layout replayTicksBulk0
+ * returns. Timestamps are in microseconds. The interval metrics throw
+ * invalid_argument for ticks out of time order.
+ */
+struct tick_columns {
+    const int64_t *ts;
+    const double *price;
+    const int32_t *size;
+    size_t n;
+};
+
+/**
+ * One row per interval that has ticks. start is the interval's start time;
+ * which value columns are filled depends on the metric.
+ */
+struct interval_series {
+    std::vector<int64_t> start;
+    std::vector<double> a;
+    std::vector<double> b;
+    std::vector<double> c;
+    std::vector<double> d;
+};
+
+/** a = volume weighted average price, b = volume. */
+void interval_vwap(const tick_columns &ticks, int64_t interval, interval_series &out);
+
+/**
+ * a = realized volatility, the square root of the sum of squared simple
+ * tick-to-tick returns within the interval.
+ */
+void interval_realized_vol(const tick_columns &ticks, int64_t interval, interval_series &out);
+
+/**
+ * a = trade imbalance in [-1, 1]: volume on upticks minus volume on
+ * downticks over total volume, by the tick rule within the interval.
+ */
+void interval_imbalance(const tick_columns &ticks, int64_t interval, interval_series &out);
+
+/** a, b, c, d = open, high, low, close. */
+void interval_ohlc(const tick_columns &ticks, int64_t interval, interval_series &out);
+
+/**
+ * Copies the ticks of one type out of a column set, for metrics that should
+ * only see trades. The returned columns point into the given vectors.
+ */
+tick_columns select_type(const tick_columns &ticks, const int8_t *types, int type,
+    std::vector<int64_t> &ts, std::vector<double> &price, std::vector<int32_t> &size);
+
+/** The instruction set the kernels run with: "avx2", "sse2" or "scalar". */
+const char *analytics_isa();
+
+#endif
+
+//############################################################################//
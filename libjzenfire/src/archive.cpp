@@ -0,0 +1,529 @@
+
+//############################################################################//
+
+/** \file archive.cpp
+ * \brief Compressed tick archive files with a per-instrument block index
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// large file offsets on 32-bit builds
+#define _FILE_OFFSET_BITS 64
+
+// I N C L U D E S ###########################################################//
+
+#include "archive.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+// stored little endian, so they read "ZFTA" and "ZFTI" in the file
+static const uint32_t ARCHIVE_MAGIC = 0x4154465a;
+static const uint32_t INDEX_MAGIC = 0x4954465a;
+static const uint32_t ARCHIVE_VERSION = 1;
+static const size_t BLOCK_HEADER = 28;
+static const size_t FOOTER = 12;
+
+// E N C O D I N G ###########################################################//
+
+static void put_u32(vector<uint8_t> &b, uint32_t v) {
+    for (int i = 0; i < 4; i ++) b.push_back((uint8_t) (v >> (8 * i)));
+}
+
+static void put_u64(vector<uint8_t> &b, uint64_t v) {
+    for (int i = 0; i < 8; i ++) b.push_back((uint8_t) (v >> (8 * i)));
+}
+
+static void put_f64(vector<uint8_t> &b, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_u64(b, bits);
+}
+
+static void put_str(vector<uint8_t> &b, const string &s) {
+    put_u32(b, (uint32_t) s.size());
+    b.insert(b.end(), s.begin(), s.end());
+}
+
+static void put_varint(vector<uint8_t> &b, uint64_t v) {
+    while (v >= 0x80) {
+        b.push_back((uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    b.push_back((uint8_t) v);
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/** Bounds checked reads from a byte buffer. */
+class decoder_t {
+    private:
+    const uint8_t *p;
+    const uint8_t *end;
+
+    void need(size_t n) {
+        if ((size_t) (end - p) < n) {
+            throw runtime_error("Corrupt tick archive");
+        }
+    }
+
+    public:
+    decoder_t(const uint8_t *p, size_t len) : p(p), end(p + len) { }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i ++) v |= (uint32_t) p[i] << (8 * i);
+        p += 4;
+        return v;
+    }
+
+    uint64_t u64() {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i ++) v |= (uint64_t) p[i] << (8 * i);
+        p += 8;
+        return v;
+    }
+
+    double f64() {
+        uint64_t bits = u64();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    string str() {
+        uint32_t len = u32();
+        need(len);
+        string s((const char *) p, len);
+        p += len;
+        return s;
+    }
+
+    uint8_t byte() {
+        need(1);
+        return *p ++;
+    }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint64_t) (b & 0x7f) << shift;
+            if (! (b & 0x80)) return v;
+        }
+        throw runtime_error("Corrupt tick archive");
+    }
+};
+
+static double effective_increment(const archive_instrument &inst) {
+    return inst.increment > 0.0 ? inst.increment : pow(10.0, -(double) inst.precision);
+}
+
+static int64_t price_ticks(double price, const archive_instrument &inst) {
+    return (int64_t) floor(price / effective_increment(inst) + 0.5);
+}
+
+static double ticks_price(int64_t ticks, const archive_instrument &inst) {
+    double price = (double) ticks * effective_increment(inst);
+    double scale = pow(10.0, (double) inst.precision);
+    return floor(price * scale + 0.5) / scale;
+}
+
+static runtime_error io_error(const string &what, const string &path) {
+    return runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+static void write_all(FILE *f, const vector<uint8_t> &b, const string &path) {
+    if (! b.empty() && fwrite(&b[0], 1, b.size(), f) != b.size()) {
+        throw io_error("Failed to write", path);
+    }
+}
+
+// W R I T E R ###############################################################//
+
+tick_archive_writer::tick_archive_writer(const string &path, uint32_t block_ticks)
+    : file(NULL), path(path), block_ticks(block_ticks > 0 ? block_ticks : 4096), closed(false) {
+
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        throw io_error("Failed to create", path);
+    }
+    vector<uint8_t> header;
+    put_u32(header, ARCHIVE_MAGIC);
+    put_u32(header, ARCHIVE_VERSION);
+    write_all(file, header, path);
+
+    pthread_mutex_init(&lock, NULL);
+}
+
+tick_archive_writer::~tick_archive_writer() {
+    try {
+        close();
+    } catch (exception &) {
+        // nowhere to report it
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+uint32_t tick_archive_writer::instrument_id(const string &symbol, const string &exchange,
+    double increment, int precision) {
+
+    pair<string, string> key(symbol, exchange);
+    map<pair<string, string>, uint32_t>::iterator it = ids.find(key);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    archive_instrument inst;
+    inst.symbol = symbol;
+    inst.exchange = exchange;
+    inst.increment = increment;
+    inst.precision = precision;
+    uint32_t id = (uint32_t) instruments.size();
+    instruments.push_back(inst);
+    pending.push_back(pending_t());
+    pending.back().ticks.reserve(block_ticks);
+    ids[key] = id;
+    return id;
+}
+
+void tick_archive_writer::flush(uint32_t id) {
+    vector<archived_tick> &ticks = pending[id].ticks;
+    if (ticks.empty()) {
+        return;
+    }
+    const archive_instrument &inst = instruments[id];
+
+    archive_block block;
+    block.instrument = id;
+    block.count = (uint32_t) ticks.size();
+    block.first_ts = ticks[0].ts;
+    block.last_ts = ticks[0].ts;
+    block.offset = (uint64_t) ftello(file);
+
+    int64_t base_ticks = price_ticks(ticks[0].price, inst);
+    int64_t prev_ts = ticks[0].ts;
+    int64_t prev_delta = 0;
+    int64_t prev_ticks = base_ticks;
+
+    scratch.clear();
+    put_u32(scratch, id);
+    put_u32(scratch, block.count);
+    put_u64(scratch, (uint64_t) ticks[0].ts);
+    put_u64(scratch, (uint64_t) base_ticks);
+    put_u32(scratch, 0); // payload length, patched below
+
+    for (size_t i = 0; i < ticks.size(); i ++) {
+        const archived_tick &t = ticks[i];
+        int64_t delta = t.ts - prev_ts;
+        put_varint(scratch, zigzag(delta - prev_delta));
+        prev_delta = delta;
+        prev_ts = t.ts;
+
+        int64_t pt = price_ticks(t.price, inst);
+        put_varint(scratch, zigzag(pt - prev_ticks));
+        prev_ticks = pt;
+
+        put_varint(scratch, zigzag(t.size));
+        scratch.push_back((uint8_t) t.type);
+
+        block.first_ts = min(block.first_ts, t.ts);
+        block.last_ts = max(block.last_ts, t.ts);
+    }
+
+    uint32_t payload = (uint32_t) (scratch.size() - BLOCK_HEADER);
+    for (int i = 0; i < 4; i ++) {
+        scratch[BLOCK_HEADER - 4 + i] = (uint8_t) (payload >> (8 * i));
+    }
+    write_all(file, scratch, path);
+
+    blocks.push_back(block);
+    ticks.clear();
+}
+
+void tick_archive_writer::append(const string &symbol, const string &exchange,
+    double increment, int precision,
+    int64_t ts, double price, int32_t size, int8_t type) {
+
+    pthread_mutex_lock(&lock);
+    if (! closed) {
+        try {
+            uint32_t id = instrument_id(symbol, exchange, increment, precision);
+            archived_tick t;
+            t.ts = ts;
+            t.price = price;
+            t.size = size;
+            t.type = type;
+            pending[id].ticks.push_back(t);
+            if (pending[id].ticks.size() >= block_ticks) {
+                flush(id);
+            }
+        } catch (exception &ex) {
+            error = ex.what();
+            closed = true;
+            fclose(file);
+            file = NULL;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void tick_archive_writer::close() {
+    pthread_mutex_lock(&lock);
+    try {
+        if (! error.empty()) {
+            string failed = error;
+            error.clear();
+            throw runtime_error(failed);
+        }
+        if (! closed) {
+            closed = true;
+            for (uint32_t id = 0; id < pending.size(); id ++) {
+                flush(id);
+            }
+
+            uint64_t index_offset = (uint64_t) ftello(file);
+            vector<uint8_t> index;
+            put_u32(index, (uint32_t) instruments.size());
+            for (size_t i = 0; i < instruments.size(); i ++) {
+                put_str(index, instruments[i].symbol);
+                put_str(index, instruments[i].exchange);
+                put_f64(index, instruments[i].increment);
+                put_u32(index, (uint32_t) instruments[i].precision);
+            }
+            put_u32(index, (uint32_t) blocks.size());
+            for (size_t i = 0; i < blocks.size(); i ++) {
+                put_u32(index, blocks[i].instrument);
+                put_u32(index, blocks[i].count);
+                put_u64(index, (uint64_t) blocks[i].first_ts);
+                put_u64(index, (uint64_t) blocks[i].last_ts);
+                put_u64(index, blocks[i].offset);
+            }
+            put_u64(index, index_offset);
+            put_u32(index, INDEX_MAGIC);
+            write_all(file, index, path);
+
+            int rc = fclose(file);
+            file = NULL;
+            if (rc != 0) {
+                throw io_error("Failed to close", path);
+            }
+        }
+    } catch (...) {
+        if (file != NULL) {
+            fclose(file);
+            file = NULL;
+        }
+        pthread_mutex_unlock(&lock);
+        throw;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// R E A D E R ###############################################################//
+
+tick_archive_reader::tick_archive_reader(const string &path) : file(NULL) {
+    file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        throw io_error("Failed to open", path);
+    }
+
+    try {
+        uint8_t buf[FOOTER];
+        if (fread(buf, 1, 8, file) != 8) {
+            throw runtime_error("Not a tick archive: " + path);
+        }
+        decoder_t header(buf, 8);
+        if (header.u32() != ARCHIVE_MAGIC || header.u32() != ARCHIVE_VERSION) {
+            throw runtime_error("Not a tick archive: " + path);
+        }
+
+        if (fseeko(file, -(off_t) FOOTER, SEEK_END) != 0 || fread(buf, 1, FOOTER, file) != FOOTER) {
+            throw runtime_error("Tick archive has no index (not closed?): " + path);
+        }
+        decoder_t footer(buf, FOOTER);
+        uint64_t index_offset = footer.u64();
+        if (footer.u32() != INDEX_MAGIC) {
+            throw runtime_error("Tick archive has no index (not closed?): " + path);
+        }
+        off_t end = ftello(file);
+        size_t index_len = (size_t) (end - (off_t) FOOTER - (off_t) index_offset);
+        vector<uint8_t> index(index_len);
+        if (fseeko(file, (off_t) index_offset, SEEK_SET) != 0
+            || (index_len > 0 && fread(&index[0], 1, index_len, file) != index_len)) {
+            throw runtime_error("Corrupt tick archive: " + path);
+        }
+
+        decoder_t d(index_len > 0 ? &index[0] : NULL, index_len);
+        uint32_t n = d.u32();
+        for (uint32_t i = 0; i < n; i ++) {
+            archive_instrument inst;
+            inst.symbol = d.str();
+            inst.exchange = d.str();
+            inst.increment = d.f64();
+            inst.precision = (int) d.u32();
+            instruments_.push_back(inst);
+        }
+        blocks.resize(n);
+        uint32_t nblocks = d.u32();
+        for (uint32_t i = 0; i < nblocks; i ++) {
+            archive_block b;
+            b.instrument = d.u32();
+            b.count = d.u32();
+            b.first_ts = (int64_t) d.u64();
+            b.last_ts = (int64_t) d.u64();
+            b.offset = d.u64();
+            if (b.instrument >= n) {
+                throw runtime_error("Corrupt tick archive: " + path);
+            }
+            blocks[b.instrument].push_back(b);
+        }
+    } catch (...) {
+        fclose(file);
+        throw;
+    }
+}
+
+tick_archive_reader::~tick_archive_reader() {
+    fclose(file);
+}
+
+int tick_archive_reader::find(const string &symbol, const string &exchange) const {
+    for (size_t i = 0; i < instruments_.size(); i ++) {
+        if (instruments_[i].symbol == symbol && instruments_[i].exchange == exchange) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+void tick_archive_reader::block_range(int id, int64_t from, int64_t to, size_t &first, size_t &last) const {
+    const vector<archive_block> &bs = blocks[id];
+    // ticks need not have been appended in time order (replayed history
+    // mixed with live ticks), so every block's min/max is checked rather
+    // than searching for the range
+    first = bs.size();
+    last = bs.size();
+    for (size_t i = 0; i < bs.size(); i ++) {
+        if (bs[i].last_ts >= from && bs[i].first_ts < to) {
+            if (first == bs.size()) {
+                first = i;
+            }
+            last = i + 1;
+        }
+    }
+}
+
+bool tick_archive_reader::in_order(int id, size_t first, size_t last) const {
+    const vector<archive_block> &bs = blocks[id];
+    for (size_t i = first + 1; i < last; i ++) {
+        if (bs[i].first_ts < bs[i - 1].last_ts) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool earlier(const archived_tick &a, const archived_tick &b) {
+    return a.ts < b.ts;
+}
+
+/** Stable sorts out from start on by timestamp, if it is not already. */
+static void sort_ticks(vector<archived_tick> &out, size_t start) {
+    for (size_t i = start + 1; i < out.size(); i ++) {
+        if (out[i].ts < out[i - 1].ts) {
+            stable_sort(out.begin() + start, out.end(), earlier);
+            return;
+        }
+    }
+}
+
+void tick_archive_reader::read_block(int id, size_t block, int64_t from, int64_t to, vector<archived_tick> &out) {
+    const archive_block &b = blocks[id][block];
+    size_t start = out.size();
+    const archive_instrument &inst = instruments_[id];
+
+    uint8_t head[BLOCK_HEADER];
+    if (fseeko(file, (off_t) b.offset, SEEK_SET) != 0 || fread(head, 1, BLOCK_HEADER, file) != BLOCK_HEADER) {
+        throw runtime_error("Corrupt tick archive");
+    }
+    decoder_t h(head, BLOCK_HEADER);
+    h.u32(); // instrument
+    uint32_t count = h.u32();
+    int64_t prev_ts = (int64_t) h.u64();
+    int64_t prev_ticks = (int64_t) h.u64();
+    uint32_t payload = h.u32();
+
+    scratch.resize(payload);
+    if (payload > 0 && fread(&scratch[0], 1, payload, file) != payload) {
+        throw runtime_error("Corrupt tick archive");
+    }
+
+    decoder_t d(payload > 0 ? &scratch[0] : NULL, payload);
+    int64_t prev_delta = 0;
+    for (uint32_t i = 0; i < count; i ++) {
+        int64_t delta = prev_delta + unzigzag(d.varint());
+        int64_t ts = prev_ts + delta;
+        prev_delta = delta;
+        prev_ts = ts;
+
+        int64_t ticks = prev_ticks + unzigzag(d.varint());
+        prev_ticks = ticks;
+
+        int32_t size = (int32_t) unzigzag(d.varint());
+        int8_t type = (int8_t) d.byte();
+
+        if (ts >= from && ts < to) {
+            archived_tick t;
+            t.ts = ts;
+            t.price = ticks_price(ticks, inst);
+            t.size = size;
+            t.type = type;
+            out.push_back(t);
+        }
+    }
+    sort_ticks(out, start);
+}
+
+void tick_archive_reader::read(int id, int64_t from, int64_t to, vector<archived_tick> &out) {
+    size_t first, last;
+    block_range(id, from, to, first, last);
+    size_t start = out.size();
+    for (size_t i = first; i < last; i ++) {
+        read_block(id, i, from, to, out);
+    }
+    if (! in_order(id, first, last)) {
+        sort_ticks(out, start);
+    }
+}
+
+//############################################################################//
@@ -0,0 +1,179 @@
+
+//############################################################################//
+
+/** \file archive.hpp
+ * \brief Compressed tick archive files with a per-instrument block index
+ *
+ * A file is a sequence of blocks, each holding up to block_ticks ticks of
+ * one instrument, followed by an instrument table and a block index:
+ *
+ *   header   "ZFTA" u32 version
+ *   block*   u32 instrument, u32 count, i64 base ts, i64 base price
+ *            ticks, u32 payload bytes, payload
+ *   index    instruments (symbol, exchange, increment, precision) and
+ *            blocks (instrument, count, first ts, last ts, offset)
+ *   footer   u64 index offset, "ZFTI"
+ *
+ * In a payload each tick is a zigzag varint delta-of-delta timestamp, a
+ * zigzag varint price delta in ticks of the instrument's increment, a
+ * varint size and a type byte. Integers are little endian. Timestamps are
+ * microseconds since the epoch.
+ *
+ * The index is written by close(); a file whose writer never closed cannot
+ * be read.
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_ARCHIVE_HPP
+#define JZENFIRE_ARCHIVE_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+struct archived_tick {
+    int64_t ts;
+    double price;
+    int32_t size;
+    int8_t type;
+};
+
+struct archive_instrument {
+    std::string symbol;
+    std::string exchange;
+    double increment;
+    int precision;
+};
+
+struct archive_block {
+    uint32_t instrument;
+    uint32_t count;
+    // earliest and latest tick; ticks appended out of order can make these
+    // other than the block's first and last
+    int64_t first_ts;
+    int64_t last_ts;
+    uint64_t offset;
+};
+
+/**
+ * Appends ticks to a new archive file. Ticks are buffered per instrument
+ * and encoded a block at a time; append() may be called from any thread.
+ * append() does not throw: a write error stops the archive and is thrown
+ * from close() instead.
+ */
+class tick_archive_writer {
+    private:
+    struct pending_t {
+        std::vector<archived_tick> ticks;
+    };
+
+    FILE *file;
+    std::string path;
+    uint32_t block_ticks;
+    bool closed;
+    std::string error;
+    std::vector<archive_instrument> instruments;
+    std::map<std::pair<std::string, std::string>, uint32_t> ids;
+    std::vector<pending_t> pending;
+    std::vector<archive_block> blocks;
+    std::vector<uint8_t> scratch;
+    pthread_mutex_t lock;
+
+    tick_archive_writer(const tick_archive_writer &);
+    tick_archive_writer& operator=(const tick_archive_writer &);
+
+    uint32_t instrument_id(const std::string &symbol, const std::string &exchange,
+        double increment, int precision);
+    void flush(uint32_t id);
+
+    public:
+    tick_archive_writer(const std::string &path, uint32_t block_ticks = 4096);
+    ~tick_archive_writer();
+
+    void append(const std::string &symbol, const std::string &exchange,
+        double increment, int precision,
+        int64_t ts, double price, int32_t size, int8_t type);
+
+    /** Flushes all blocks and writes the index. Later appends are dropped. */
+    void close();
+};
+
+/**
+ * Reads an archive through its index. Not thread safe; use one reader per
+ * thread.
+ */
+class tick_archive_reader {
+    private:
+    FILE *file;
+    std::vector<archive_instrument> instruments_;
+    // per instrument, in file order
+    std::vector<std::vector<archive_block> > blocks;
+    std::vector<uint8_t> scratch;
+
+    tick_archive_reader(const tick_archive_reader &);
+    tick_archive_reader& operator=(const tick_archive_reader &);
+
+    public:
+    tick_archive_reader(const std::string &path);
+    ~tick_archive_reader();
+
+    const std::vector<archive_instrument> &instruments() const { return instruments_; }
+
+    /** Instrument id, or -1 if the archive has no ticks for it. */
+    int find(const std::string &symbol, const std::string &exchange) const;
+
+    /**
+     * Range [first, last) of the instrument's blocks that may hold ticks
+     * in [from, to). Blocks inside it that do not overlap the range decode
+     * to nothing.
+     */
+    void block_range(int id, int64_t from, int64_t to, size_t &first, size_t &last) const;
+
+    /**
+     * True if no block in [first, last) starts before an earlier one ends,
+     * so blocks read in turn give ticks in timestamp order.
+     */
+    bool in_order(int id, size_t first, size_t last) const;
+
+    /**
+     * Decodes one block, appending its ticks within [from, to) to out in
+     * timestamp order, ticks with equal timestamps in the order appended.
+     */
+    void read_block(int id, size_t block, int64_t from, int64_t to, std::vector<archived_tick> &out);
+
+    /**
+     * All of an instrument's ticks within [from, to), in timestamp order
+     * whatever order they were appended in; ticks with equal timestamps
+     * keep the order appended.
+     */
+    void read(int id, int64_t from, int64_t to, std::vector<archived_tick> &out);
+};
+
+#endif
+
+//############################################################################//
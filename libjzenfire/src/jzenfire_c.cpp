@@ -0,0 +1,702 @@
+
+//############################################################################//
+
+/** \file jzenfire_c.cpp
+ * \brief Plain C interface to libzenfire, for foreign function callers
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "jzenfire_c.h"
+#include "threads.hpp"
+#include "throttle.hpp"
+
+#include <zenfire/client.hpp>
+#include <zenfire/error.hpp>
+#include <zenfire/arg.hpp>
+#include <zenfire/product.hpp>
+
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+static __thread char last_error[256];
+static __thread int32_t last_error_len;
+
+static void set_error(const char *what) {
+    size_t len = strlen(what);
+    last_error_len = (int32_t) len;
+    if (len >= sizeof(last_error)) {
+        len = sizeof(last_error) - 1;
+    }
+    memcpy(last_error, what, len);
+    last_error[len] = 0;
+}
+
+static int fail(exception &ex) {
+    int code = JZF_ERROR;
+    if (dynamic_cast<zenfire::error::access_t*>(&ex) != 0) {
+        code = JZF_EACCESS;
+    } else if (dynamic_cast<zenfire::error::connection_t*>(&ex) != 0) {
+        code = JZF_ECONNECTION;
+    } else if (dynamic_cast<zenfire::error::timeout_t*>(&ex) != 0) {
+        code = JZF_ETIMEOUT;
+    } else if (dynamic_cast<zenfire::error::invalid_t*>(&ex) != 0) {
+        code = JZF_EINVALID;
+    } else if (dynamic_cast<zenfire::error::invalid_account_t*>(&ex) != 0) {
+        code = JZF_EINVALID_ACCOUNT;
+    } else if (dynamic_cast<zenfire::error::invalid_product_t*>(&ex) != 0) {
+        code = JZF_EINVALID_INSTRUMENT;
+    } else if (dynamic_cast<zenfire::error::internal_t*>(&ex) != 0) {
+        code = JZF_EINTERNAL;
+    } else if (dynamic_cast<invalid_argument*>(&ex) != 0) {
+        code = JZF_EINVALID;
+    }
+    const char *what = ex.what();
+    set_error(what ? what : "(no message)");
+    return code;
+}
+
+/** For anything thrown that is not a std::exception; none may unwind into C. */
+static int fail_unknown() {
+    set_error("unknown error");
+    return JZF_ERROR;
+}
+
+/** The body of a read that returns a value: failed if it throws. */
+#define GUARDED_READ(expr, failed) \
+    try { return expr; } catch (exception &ex) { fail(ex); } catch (...) { fail_unknown(); } \
+    return failed;
+
+static string str(const char *s) {
+    return s == NULL ? string() : string(s);
+}
+
+static int32_t copy_out(const string &s, char *buf, int32_t len) {
+    if (buf != NULL && len > 0) {
+        size_t n = s.size() < (size_t) len - 1 ? s.size() : (size_t) len - 1;
+        memcpy(buf, s.data(), n);
+        buf[n] = 0;
+    }
+    return (int32_t) s.size();
+}
+
+static void copy_fixed(char *dst, size_t len, const string &s) {
+    copy_out(s, dst, (int32_t) len);
+}
+
+static int32_t copy_list(const vector<string> &names, char *buf, int32_t len) {
+    string all;
+    for (size_t i = 0; i < names.size(); i ++) {
+        all += names[i];
+        all += '\0';
+    }
+    if (buf != NULL && len > 0) {
+        size_t n = all.size() < (size_t) len ? all.size() : (size_t) len;
+        memcpy(buf, all.data(), n);
+    }
+    return (int32_t) all.size();
+}
+
+static int64_t micros(long ts, long usec) {
+    return ((int64_t) ts) * 1000000 + (int64_t) usec;
+}
+
+class c_tick_hook {
+    private:
+    jzf_callbacks cb;
+
+    public:
+    c_tick_hook(const jzf_callbacks &cb) : cb(cb) { }
+
+    void operator()(const zenfire::tick::tick_t &tick) {
+        callback_threads.enter();
+
+        string exchange = zenfire::exchange::to_string(tick.product->exchange);
+        jzf_tick t;
+        t.type = tick.typ_;
+        t.size = tick.size;
+        t.ts = micros(tick.ts, tick.usec);
+        t.price = tick.price;
+        t.symbol = tick.product->symbol.c_str();
+        t.exchange = exchange.c_str();
+        cb.tick(cb.ctx, &t);
+    }
+};
+
+/**
+ * Owns a client's orders in the throttle, so its queued actions can be
+ * dropped before the client is freed and their failures raised as alerts.
+ */
+class c_client_owner : public throttle_owner_t {
+    private:
+    jzf_callbacks cb;
+
+    public:
+    c_client_owner(const jzf_callbacks &cb) : cb(cb) { }
+
+    void queued_action_failed(const zenfire::order_ptr &order, throttle_op_t op, const string &what) {
+        if (cb.alert == NULL) {
+            return;
+        }
+        jzf_alert a;
+        a.type = JZF_ALERT_ACTION_FAILED;
+        a.number = (int32_t) order->number();
+        a.message = what.c_str();
+        cb.alert(cb.ctx, &a);
+    }
+};
+
+/** What a jzf_order handle points to. */
+struct c_order_t {
+    zenfire::order_ptr order;
+    c_client_owner *owner;
+
+    c_order_t(const zenfire::order_ptr &order, c_client_owner *owner) : order(order), owner(owner) { }
+};
+
+static pthread_mutex_t owners_lock = PTHREAD_MUTEX_INITIALIZER;
+static map<zenfire::client_t *, c_client_owner *> owners;
+
+static c_client_owner *owner(zenfire::client_t *zf) {
+    pthread_mutex_lock(&owners_lock);
+    map<zenfire::client_t *, c_client_owner *>::iterator it = owners.find(zf);
+    c_client_owner *o = it == owners.end() ? NULL : it->second;
+    pthread_mutex_unlock(&owners_lock);
+    if (o == NULL) {
+        throw invalid_argument("Unknown client");
+    }
+    return o;
+}
+
+class c_report_hook {
+    private:
+    jzf_callbacks cb;
+    c_client_owner *owner;
+
+    public:
+    c_report_hook(const jzf_callbacks &cb, c_client_owner *owner) : cb(cb), owner(owner) { }
+
+    void operator()(const zenfire::report::report_t &report) {
+        callback_threads.enter();
+
+        // borrowed: the handle lives on this stack frame
+        c_order_t order(report.order, owner);
+        string message = report.message();
+        jzf_report r;
+        r.type = report.typ_;
+        r.qty = report.qty();
+        r.price = report.price();
+        r.order = (jzf_order) &order;
+        r.ts = micros(report.ts, report.usec);
+        r.message = message.c_str();
+        cb.report(cb.ctx, &r);
+    }
+};
+
+class c_alert_hook {
+    private:
+    jzf_callbacks cb;
+
+    public:
+    c_alert_hook(const jzf_callbacks &cb) : cb(cb) { }
+
+    void operator()(const zenfire::alert::alert_t &alert) {
+        callback_threads.enter();
+
+        string message = alert.message();
+        jzf_alert a;
+        a.type = alert.type();
+        a.number = alert.number();
+        a.message = message.c_str();
+        cb.alert(cb.ctx, &a);
+    }
+};
+
+#define CLIENT(h) ((zenfire::client_t *)(h))
+#define HANDLE(h) ((c_order_t *)(h))
+#define ORDER(h) (HANDLE(h)->order)
+
+extern "C" {
+
+int32_t jzf_last_error(char *buf, int32_t len) {
+    if (buf != NULL && len > 0) {
+        size_t n = strlen(last_error);
+        if (n > (size_t) len - 1) {
+            n = (size_t) len - 1;
+        }
+        memcpy(buf, last_error, n);
+        buf[n] = 0;
+    }
+    return last_error_len;
+}
+
+int jzf_create(const char *path, const jzf_callbacks *callbacks, jzf_client *out) {
+    zenfire::client_t *zf = NULL;
+    c_client_owner *o = NULL;
+    try {
+        zf = zenfire::client::create(str(path));
+        jzf_callbacks cb;
+        memset(&cb, 0, sizeof(cb));
+        if (callbacks != NULL) {
+            cb = *callbacks;
+        }
+        o = new c_client_owner(cb);
+
+        if (cb.alert != NULL) zf->hook_alerts(c_alert_hook(cb));
+        if (cb.report != NULL) zf->hook_reports(c_report_hook(cb, o));
+        if (cb.tick != NULL) zf->hook_ticks(c_tick_hook(cb));
+
+        // registered last, so a failure above leaves nothing behind
+        pthread_mutex_lock(&owners_lock);
+        try {
+            owners[zf] = o;
+        } catch (...) {
+            pthread_mutex_unlock(&owners_lock);
+            throw;
+        }
+        pthread_mutex_unlock(&owners_lock);
+        *out = (jzf_client) zf;
+        return JZF_OK;
+    } catch (exception &ex) {
+        delete zf;
+        delete o;
+        return fail(ex);
+    } catch (...) {
+        delete zf;
+        delete o;
+        return fail_unknown();
+    }
+}
+
+void jzf_free(jzf_client client) {
+    try {
+        zenfire::client_t *zf = CLIENT(client);
+        c_client_owner *o = NULL;
+        pthread_mutex_lock(&owners_lock);
+        map<zenfire::client_t *, c_client_owner *>::iterator it = owners.find(zf);
+        if (it != owners.end()) {
+            o = it->second;
+            owners.erase(it);
+        }
+        pthread_mutex_unlock(&owners_lock);
+        if (o != NULL) {
+            // queued actions use the client's orders
+            throttle.forget(o);
+        }
+        delete zf;
+        delete o;
+    } catch (...) {
+        // nothing to report it through
+    }
+}
+
+int jzf_login(jzf_client client, const char *user, const char *passwd, const char *environment) {
+    try {
+        CLIENT(client)->login(str(user), str(passwd), str(environment));
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_logout(jzf_client client) {
+    try {
+        CLIENT(client)->logout();
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_get_option(jzf_client client, const char *option, int32_t *out) {
+    try {
+        string name = str(option);
+        int value;
+        if (get_thread_option(name, value)) {
+            *out = value;
+        } else {
+            *out = CLIENT(client)->option(name);
+        }
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_set_option(jzf_client client, const char *option, int32_t value) {
+    try {
+        string name = str(option);
+        if (! set_thread_option(name, value)) {
+            CLIENT(client)->option(name, value);
+        }
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int32_t jzf_list_environments(jzf_client client, char *buf, int32_t len) {
+    try {
+        return copy_list(CLIENT(client)->list_environments(), buf, len);
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int32_t jzf_list_accounts(jzf_client client, char *buf, int32_t len) {
+    try {
+        return copy_list(CLIENT(client)->list_accounts(), buf, len);
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_lookup_account(jzf_client client, const char *name, int32_t *out) {
+    try {
+        *out = CLIENT(client)->lookup_account(str(name));
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_subscribe_account(jzf_client client, int32_t acctno, int32_t flags) {
+    try {
+        CLIENT(client)->subscribe_account(acctno, flags);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_unsubscribe_account(jzf_client client, int32_t acctno) {
+    try {
+        CLIENT(client)->unsubscribe_account(acctno);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_cancel_all(jzf_client client, int32_t acctno) {
+    try {
+        CLIENT(client)->cancel_all(acctno);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_lookup_instrument(jzf_client client, const char *symbol, const char *exchange, jzf_instrument *out) {
+    try {
+        zenfire::product_t prod = CLIENT(client)->lookup_product(zenfire::arg::product(str(symbol), str(exchange)));
+        memset(out, 0, sizeof(*out));
+        copy_fixed(out->symbol, sizeof(out->symbol), prod.symbol);
+        copy_fixed(out->exchange, sizeof(out->exchange), zenfire::exchange::to_string(prod.exchange));
+        out->increment = prod.increment;
+        out->precision = prod.precision;
+        out->has_specs = prod.has_specs ? 1 : 0;
+        if (prod.has_specs) {
+            out->point_value = prod.point_value;
+            copy_fixed(out->currency, sizeof(out->currency), prod.currency);
+            copy_fixed(out->description, sizeof(out->description), prod.description);
+        }
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_subscribe(jzf_client client, const char *symbol, const char *exchange, uint32_t flags) {
+    try {
+        zenfire::client_t *zf = CLIENT(client);
+        zf->subscribe(zf->lookup_product(zenfire::arg::product(str(symbol), str(exchange))), flags);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_unsubscribe(jzf_client client, const char *symbol, const char *exchange) {
+    try {
+        zenfire::client_t *zf = CLIENT(client);
+        zf->unsubscribe(zf->lookup_product(zenfire::arg::product(str(symbol), str(exchange))));
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_replay_ticks(jzf_client client, const char *symbol, const char *exchange, int32_t from, int32_t to) {
+    try {
+        zenfire::client_t *zf = CLIENT(client);
+        zf->replay_ticks(zf->lookup_product(zenfire::arg::product(str(symbol), str(exchange))), from, to);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+static int order(jzf_client client, bool prepare, const jzf_order_args *a, jzf_order *out) {
+    try {
+        zenfire::client_t *zf = CLIENT(client);
+        int account_number = zf->lookup_account(str(a->account));
+
+        zenfire::arg::market args = zenfire::arg::market();
+        args.product = zf->lookup_product(zenfire::arg::product(str(a->symbol), str(a->exchange)));
+        args.action = (zenfire::order::action_t) a->action;
+        args.qty = a->qty;
+        args.duration = (zenfire::order::duration_t) a->duration;
+        args.zentag = str(a->zentag);
+        args.tag = str(a->tag);
+
+        // while rates are set, an order is prepared here and its send paced
+        bool paced = ! prepare && throttle.limited();
+        bool hold = prepare || paced;
+        zenfire::order_ptr order;
+        switch (a->type) {
+            case 1: {
+                order = hold
+                    ? zf->prepare_order(args, account_number)
+                    : zf->place_order(args, account_number);
+                break;
+            }
+            case 2: {
+                zenfire::arg::limit largs(a->limit_price, args);
+                order = hold
+                    ? zf->prepare_order(largs, account_number)
+                    : zf->place_order(largs, account_number);
+                break;
+            }
+            case 3: {
+                zenfire::arg::stop_market sargs(a->trigger_price, args);
+                order = hold
+                    ? zf->prepare_order(sargs, account_number)
+                    : zf->place_order(sargs, account_number);
+                break;
+            }
+            case 4: {
+                zenfire::arg::stop_limit slargs(a->trigger_price, zenfire::arg::limit(a->limit_price, args));
+                order = hold
+                    ? zf->prepare_order(slargs, account_number)
+                    : zf->place_order(slargs, account_number);
+                break;
+            }
+            default:
+                throw invalid_argument("unknown order type");
+        }
+        c_client_owner *o = owner(zf);
+        if (paced) {
+            throttle.submit(o, order, THROTTLE_SEND);
+        }
+        *out = (jzf_order) new c_order_t(order, o);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_place_order(jzf_client client, const jzf_order_args *args, jzf_order *out) {
+    return order(client, false, args, out);
+}
+
+int jzf_prepare_order(jzf_client client, const jzf_order_args *args, jzf_order *out) {
+    return order(client, true, args, out);
+}
+
+jzf_order jzf_order_retain(jzf_order order) {
+    GUARDED_READ((jzf_order) new c_order_t(*HANDLE(order)), NULL)
+}
+
+void jzf_order_free(jzf_order order) {
+    try {
+        delete HANDLE(order);
+    } catch (...) {
+        // nothing to report it through
+    }
+}
+
+int32_t jzf_order_status(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->status(), JZF_ERROR) }
+int32_t jzf_order_type(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->type(), JZF_ERROR) }
+int32_t jzf_order_side(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->action(), JZF_ERROR) }
+int32_t jzf_order_duration(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->duration(), JZF_ERROR) }
+int32_t jzf_order_reason(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->reason(), JZF_ERROR) }
+int32_t jzf_order_number(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->number(), JZF_ERROR) }
+int32_t jzf_order_qty(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->qty(), JZF_ERROR) }
+int32_t jzf_order_qty_open(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->open(), JZF_ERROR) }
+int32_t jzf_order_qty_filled(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->filled(), JZF_ERROR) }
+int32_t jzf_order_qty_cancelled(jzf_order order) { GUARDED_READ((int32_t) ORDER(order)->canceled(), JZF_ERROR) }
+double jzf_order_limit_price(jzf_order order) { GUARDED_READ(ORDER(order)->price(), numeric_limits<double>::quiet_NaN()) }
+double jzf_order_trigger_price(jzf_order order) { GUARDED_READ(ORDER(order)->trigger(), numeric_limits<double>::quiet_NaN()) }
+double jzf_order_avg_fill_price(jzf_order order) { GUARDED_READ(ORDER(order)->fill_price(), numeric_limits<double>::quiet_NaN()) }
+
+int32_t jzf_order_message(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(ORDER(order)->message(), buf, len), JZF_ERROR)
+}
+
+int32_t jzf_order_account(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(ORDER(order)->acct(), buf, len), JZF_ERROR)
+}
+
+int32_t jzf_order_symbol(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(ORDER(order)->product().symbol, buf, len), JZF_ERROR)
+}
+
+int32_t jzf_order_exchange(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(zenfire::exchange::to_string(ORDER(order)->product().exchange), buf, len), JZF_ERROR)
+}
+
+int32_t jzf_order_tag(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(ORDER(order)->tag(), buf, len), JZF_ERROR)
+}
+
+int32_t jzf_order_zentag(jzf_order order, char *buf, int32_t len) {
+    GUARDED_READ(copy_out(ORDER(order)->zentag(), buf, len), JZF_ERROR)
+}
+
+int jzf_order_set_price(jzf_order order, double price) {
+    try {
+        ORDER(order)->set_price(price);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_order_set_qty(jzf_order order, int32_t qty) {
+    try {
+        ORDER(order)->set_qty(qty);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_order_set_trigger(jzf_order order, double trigger) {
+    try {
+        ORDER(order)->set_trigger(trigger);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_order_send(jzf_order order) {
+    try {
+        throttle.submit(HANDLE(order)->owner, ORDER(order), THROTTLE_SEND);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_order_update(jzf_order order) {
+    try {
+        throttle.submit(HANDLE(order)->owner, ORDER(order), THROTTLE_UPDATE);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_order_cancel(jzf_order order, const char *reason) {
+    try {
+        throttle.submit(HANDLE(order)->owner, ORDER(order), THROTTLE_CANCEL, str(reason));
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_throttle_account_rate(const char *account, double per_second, int32_t burst) {
+    try {
+        throttle.account_rate(str(account), per_second, burst);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+int jzf_throttle_instrument_rate(const char *symbol, const char *exchange, double per_second, int32_t burst) {
+    try {
+        throttle.instrument_rate(str(symbol), str(exchange), per_second, burst);
+        return JZF_OK;
+    } catch (exception &ex) {
+        return fail(ex);
+    } catch (...) {
+        return fail_unknown();
+    }
+}
+
+}
+
+//############################################################################//
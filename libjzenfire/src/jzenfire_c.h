@@ -0,0 +1,221 @@
+
+/*############################################################################*/
+
+/** \file jzenfire_c.h
+ * \brief Plain C interface to libzenfire, for foreign function callers
+ *
+ * Everything here uses fixed-width integers, plain structs and buffers owned
+ * by the caller, so it can be bound with Java's Foreign Function & Memory
+ * API (downcall handles, upcall stubs) without going through JNI.
+ *
+ * Functions returning int return JZF_OK or one of the JZF_E* codes; the
+ * message of the last failure on the calling thread is available from
+ * jzf_last_error(). No C++ exception ever unwinds into the caller. Order
+ * handles are the same as the JNI binding's, so handles may be passed
+ * between the two.
+ */
+
+/* L I C E N S E ##############################################################*/
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_C_H
+#define JZENFIRE_C_H
+
+/* I N C L U D E S ############################################################*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JZF_OK                   0
+#define JZF_EACCESS             -1
+#define JZF_ECONNECTION         -2
+#define JZF_ETIMEOUT            -3
+#define JZF_EINVALID            -4
+#define JZF_EINVALID_ACCOUNT    -5
+#define JZF_EINVALID_INSTRUMENT -6
+#define JZF_EINTERNAL           -7
+#define JZF_ERROR               -8
+
+/**
+ * Alert type for an order action that was queued by the throttle and
+ * failed once sent; the number is the order number, the message the error.
+ */
+#define JZF_ALERT_ACTION_FAILED -1
+
+typedef int64_t jzf_client;
+typedef int64_t jzf_order;
+
+/** Strings are only valid for the duration of the callback. */
+typedef struct jzf_tick {
+    int32_t type;
+    int32_t size;
+    int64_t ts;            /* microseconds since the epoch */
+    double price;
+    const char *symbol;
+    const char *exchange;
+} jzf_tick;
+
+/**
+ * The order handle is borrowed for the duration of the callback; keep it
+ * with jzf_order_retain().
+ */
+typedef struct jzf_report {
+    int32_t type;
+    int32_t qty;
+    double price;
+    jzf_order order;
+    int64_t ts;            /* microseconds since the epoch */
+    const char *message;
+} jzf_report;
+
+typedef struct jzf_alert {
+    int32_t type;
+    int32_t number;
+    const char *message;
+} jzf_alert;
+
+typedef void (*jzf_tick_fn)(void *ctx, const jzf_tick *tick);
+typedef void (*jzf_report_fn)(void *ctx, const jzf_report *report);
+typedef void (*jzf_alert_fn)(void *ctx, const jzf_alert *alert);
+
+/**
+ * Any callback may be NULL. They run on libzenfire's threads, except
+ * JZF_ALERT_ACTION_FAILED alerts, which come from the throttle's thread.
+ */
+typedef struct jzf_callbacks {
+    jzf_tick_fn tick;
+    jzf_report_fn report;
+    jzf_alert_fn alert;
+    void *ctx;
+} jzf_callbacks;
+
+typedef struct jzf_instrument {
+    char symbol[32];
+    char exchange[16];
+    double increment;
+    int32_t precision;
+    int32_t has_specs;
+    double point_value;
+    char currency[16];
+    char description[128];
+} jzf_instrument;
+
+/** type: 1 market, 2 limit, 3 stop market, 4 stop limit, as placeOrder0. */
+typedef struct jzf_order_args {
+    int32_t type;
+    int32_t action;
+    int32_t qty;
+    int32_t duration;
+    double limit_price;
+    double trigger_price;
+    const char *account;
+    const char *symbol;
+    const char *exchange;
+    const char *zentag;
+    const char *tag;
+} jzf_order_args;
+
+/** Copies the last error message, returns its full length. */
+int32_t jzf_last_error(char *buf, int32_t len);
+
+int jzf_create(const char *path, const jzf_callbacks *callbacks, jzf_client *out);
+void jzf_free(jzf_client client);
+
+int jzf_login(jzf_client client, const char *user, const char *passwd, const char *environment);
+int jzf_logout(jzf_client client);
+
+int jzf_get_option(jzf_client client, const char *option, int32_t *out);
+int jzf_set_option(jzf_client client, const char *option, int32_t value);
+
+/**
+ * Lists environments or accounts as NUL separated names. Returns the
+ * length needed, which may exceed len, or a negative error code.
+ */
+int32_t jzf_list_environments(jzf_client client, char *buf, int32_t len);
+int32_t jzf_list_accounts(jzf_client client, char *buf, int32_t len);
+
+int jzf_lookup_account(jzf_client client, const char *name, int32_t *out);
+int jzf_subscribe_account(jzf_client client, int32_t acctno, int32_t flags);
+int jzf_unsubscribe_account(jzf_client client, int32_t acctno);
+int jzf_cancel_all(jzf_client client, int32_t acctno);
+
+int jzf_lookup_instrument(jzf_client client, const char *symbol, const char *exchange, jzf_instrument *out);
+int jzf_subscribe(jzf_client client, const char *symbol, const char *exchange, uint32_t flags);
+int jzf_unsubscribe(jzf_client client, const char *symbol, const char *exchange);
+int jzf_replay_ticks(jzf_client client, const char *symbol, const char *exchange, int32_t from, int32_t to);
+
+int jzf_place_order(jzf_client client, const jzf_order_args *args, jzf_order *out);
+int jzf_prepare_order(jzf_client client, const jzf_order_args *args, jzf_order *out);
+
+/** Returns a new handle to the same order, to be freed separately; NULL if out of memory. */
+jzf_order jzf_order_retain(jzf_order order);
+void jzf_order_free(jzf_order order);
+
+/*
+ * Field reads; these do not fail in practice and are safe as critical
+ * downcalls. Should libzenfire throw anyway they return JZF_ERROR, or NaN
+ * for prices, and set the last error.
+ */
+int32_t jzf_order_status(jzf_order order);
+int32_t jzf_order_type(jzf_order order);
+int32_t jzf_order_side(jzf_order order);
+int32_t jzf_order_duration(jzf_order order);
+int32_t jzf_order_reason(jzf_order order);
+int32_t jzf_order_number(jzf_order order);
+int32_t jzf_order_qty(jzf_order order);
+int32_t jzf_order_qty_open(jzf_order order);
+int32_t jzf_order_qty_filled(jzf_order order);
+int32_t jzf_order_qty_cancelled(jzf_order order);
+double jzf_order_limit_price(jzf_order order);
+double jzf_order_trigger_price(jzf_order order);
+double jzf_order_avg_fill_price(jzf_order order);
+
+/** String fields, copied NUL terminated; return the full length, or a negative error code. */
+int32_t jzf_order_message(jzf_order order, char *buf, int32_t len);
+int32_t jzf_order_account(jzf_order order, char *buf, int32_t len);
+int32_t jzf_order_symbol(jzf_order order, char *buf, int32_t len);
+int32_t jzf_order_exchange(jzf_order order, char *buf, int32_t len);
+int32_t jzf_order_tag(jzf_order order, char *buf, int32_t len);
+int32_t jzf_order_zentag(jzf_order order, char *buf, int32_t len);
+
+int jzf_order_set_price(jzf_order order, double price);
+int jzf_order_set_qty(jzf_order order, int32_t qty);
+int jzf_order_set_trigger(jzf_order order, double trigger);
+int jzf_order_send(jzf_order order);
+int jzf_order_update(jzf_order order);
+int jzf_order_cancel(jzf_order order, const char *reason);
+
+/**
+ * Message rate limits for order sends, modifies and cancels, process wide
+ * and shared with Java clients. An action over its limit is queued and
+ * sent when the limit allows; a rate <= 0 removes the limit.
+ */
+int jzf_throttle_account_rate(const char *account, double per_second, int32_t burst);
+int jzf_throttle_instrument_rate(const char *symbol, const char *exchange, double per_second, int32_t burst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*############################################################################*/
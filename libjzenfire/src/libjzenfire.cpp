@@ -33,18 +33,39 @@
 #include <zenfire/arg.hpp>
 #include <zenfire/product.hpp>
 
+#include "analytics.hpp"
+#include "archive.hpp"
+#include "merge_replay.hpp"
+#include "shm_ring.hpp"
+#include "synthetic.hpp"
+#include "threads.hpp"
+#include "throttle.hpp"
+#include "trace.hpp"
+
 #include <iostream>
 #include <sstream>
 #include <ctime>
 #include <cstdlib>
+#include <cmath>
 #include <string>
+#include <stdexcept>
+#include <new>
+#include <map>
+#include <deque>
+#include <vector>
+#include <utility>
+
+#include <pthread.h>
+#include <sched.h>
 
 using namespace std;
 
 JavaVM *the_vm;
 jclass ClientImpl;
 jmethodID invokeCallback_tick;
+jmethodID invokeCallback_tick_ticks;
 jmethodID invokeCallback_report;
+jmethodID invokeCallback_report_lazy;
 jmethodID invokeCallback_alert;
 
 jclass OutOfMemoryError;
@@ -57,6 +78,7 @@ jclass InvalidInstrumentException;
 jclass InternalException;
 jclass ZenFireException;
 jclass String;
+jclass Object;
 jclass Instrument;
 jmethodID Instrument_init;
 jclass Instrument_Specification;
@@ -66,8 +88,16 @@ jmethodID BigDecimal_init;
 jclass MathContext;
 jmethodID MathContext_init;
 
+// natives bound by JNI_OnLoad, of the table at the end of this file
+extern int natives_registered;
+void register_natives(JNIEnv *env);
+
 extern "C" jint JNI_OnLoad(JavaVM *vm, void *reserved) {
     the_vm = vm;
+    JNIEnv *env;
+    if (vm->GetEnv((void **) &env, JNI_VERSION_1_4) == JNI_OK) {
+        register_natives(env);
+    }
     return JNI_VERSION_1_4;
 }
 
@@ -163,624 +193,3325 @@ class global_ref {
     }
 };
 
-class tick_callback_t {
+class mutex_t {
+    private:
+    pthread_mutex_t m;
+
+    mutex_t(const mutex_t &);
+    mutex_t& operator=(const mutex_t &);
+
+    public:
+    mutex_t() { pthread_mutex_init(&m, NULL); }
+    ~mutex_t() { pthread_mutex_destroy(&m); }
+
+    void lock() { pthread_mutex_lock(&m); }
+    void unlock() { pthread_mutex_unlock(&m); }
+    pthread_mutex_t *native() { return &m; }
+};
 
+class scoped_lock {
     private:
-    global_ref obj;
+    mutex_t &m;
+
+    scoped_lock(const scoped_lock &);
+    scoped_lock& operator=(const scoped_lock &);
 
     public:
-    tick_callback_t(global_ref obj) : obj(obj) {}
+    scoped_lock(mutex_t &m) : m(m) { m.lock(); }
+    ~scoped_lock() { m.unlock(); }
+};
 
-    ~tick_callback_t() { }
+/**
+ * What a Java order handle points to: the order and the client state it
+ * was handed out by, which owns its throttled actions. Handles passed with
+ * a lazy report or a snapshot also carry the report's message, held back
+ * from the upcall until reportGetMessage0 asks for it.
+ */
+struct order_handle_t {
+    zenfire::order_ptr order;
+    throttle_owner_t *owner;
+    string message;
+
+    order_handle_t(const zenfire::order_ptr &order, throttle_owner_t *owner)
+        : order(order), owner(owner) { }
+    order_handle_t(const zenfire::order_ptr &order, throttle_owner_t *owner, const string &message)
+        : order(order), owner(owner), message(message) { }
+};
 
-    void operator()(const zenfire::tick::tick_t& tick) {
-        env_attachment a;
+jlong monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((jlong) ts.tv_sec) * 1000000000L + ts.tv_nsec;
+}
 
-        jstring symbol = a.env()->NewStringUTF(tick.product->symbol.c_str());
-        jstring exchange = a.env()->NewStringUTF(zenfire::exchange::to_string(tick.product->exchange).c_str());
+/**
+ * Coalesced order modifies, one coalescer per client. At most one modify per
+ * order is in flight; changes made while it is outstanding are merged into a
+ * single pending modify, newer values replacing older ones, which goes out
+ * when the order's modify is acknowledged or rejected. Entries exist only
+ * while a modify is in flight.
+ *
+ * libzenfire's report types are not known here, so the feed's modify ack and
+ * reject types are set per client as jzenfire.modify_ack_type and
+ * jzenfire.modify_reject_type. Until both are, every modify goes straight
+ * out. A report that leaves the order with nothing open also ends its
+ * modify, dropping any pending changes.
+ */
+enum {
+    MODIFY_PRICE = 1,
+    MODIFY_QTY = 2,
+    MODIFY_TRIGGER = 4
+};
 
-        a.env()->CallVoidMethod(obj.obj(),
-            invokeCallback_tick,
-            (jint) tick.typ_,
-            (jint) 0,
-            (jobject) symbol,
-            (jobject) exchange,
-            ((jlong)tick.ts) * 1000L + ((jlong)tick.usec / 1000L), // millis
-            (((jint)tick.usec) % 1000) * 1000, // nanos
-            (jdouble) tick.price,
-            (jint) tick.size);
+struct pending_modify_t {
+    zenfire::order_ptr order;
+    int fields;
+    double price;
+    int qty;
+    double trigger;
+    // send() is running for this order; an ack meanwhile is noted in acked
+    bool sending;
+    bool acked;
+
+    pending_modify_t() : fields(0), price(0.0), qty(0), trigger(0.0), sending(false), acked(false) { }
+
+    void merge(int fields, double price, int qty, double trigger) {
+        if (fields & MODIFY_PRICE) this->price = price;
+        if (fields & MODIFY_QTY) this->qty = qty;
+        if (fields & MODIFY_TRIGGER) this->trigger = trigger;
+        this->fields |= fields;
     }
-};
 
-class alert_callback_t {
+    /** Sets the fields and updates the order, here or on the throttle's sender thread. */
+    void send(throttle_owner_t *owner, bool deferred) const {
+        if (fields & MODIFY_PRICE) order->set_price(price);
+        if (fields & MODIFY_QTY) order->set_qty(qty);
+        if (fields & MODIFY_TRIGGER) order->set_trigger(trigger);
+        if (deferred) {
+            throttle.defer(owner, order, THROTTLE_UPDATE);
+        } else {
+            throttle.submit(owner, order, THROTTLE_UPDATE);
+        }
+    }
+};
 
+class modify_coalescer_t {
     private:
-    global_ref obj;
+    // hears of modifies that fail on the throttle's sender thread
+    throttle_owner_t *owner;
+    mutex_t lock;
+    map<const void *, pending_modify_t> modifies;
+    volatile int in_flight;
+    long long sent;
+    long long coalesced;
+
+    modify_coalescer_t(const modify_coalescer_t &);
+    modify_coalescer_t& operator=(const modify_coalescer_t &);
+
+    /**
+     * Sends now, then whatever was merged in if the modify was acknowledged
+     * while send() ran, until a modify is left in flight or nothing is
+     * pending. The entry is dropped and the error rethrown if a send fails.
+     */
+    void send_modifies(pending_modify_t now, bool deferred) {
+        for (;;) {
+            try {
+                now.send(owner, deferred);
+            } catch (exception &) {
+                scoped_lock l(lock);
+                modifies.erase(now.order.get());
+                in_flight = modifies.size();
+                throw;
+            }
+
+            scoped_lock l(lock);
+            map<const void *, pending_modify_t>::iterator it = modifies.find(now.order.get());
+            if (it == modifies.end()) {
+                return;
+            }
+            pending_modify_t &m = it->second;
+            m.sending = false;
+            if (! m.acked) {
+                return;
+            }
+            m.acked = false;
+            if (m.fields == 0 || m.order->open() == 0) {
+                modifies.erase(it);
+                in_flight = modifies.size();
+                return;
+            }
+            now = m;
+            m.fields = 0;
+            m.sending = true;
+            sent ++;
+        }
+    }
 
     public:
-    alert_callback_t(global_ref obj) : obj(obj) {}
+    volatile int ack_type;
+    volatile int reject_type;
+
+    modify_coalescer_t(throttle_owner_t *owner)
+        : owner(owner), in_flight(0), sent(0), coalesced(0), ack_type(-1), reject_type(-1) { }
+
+    /** Sends the modify now, or merges it into the pending one. Returns true if sent. */
+    bool modify(const zenfire::order_ptr &order, int fields, double price, int qty, double trigger) {
+        pending_modify_t now;
+        now.order = order;
+        now.merge(fields, price, qty, trigger);
+
+        if (ack_type < 0 || reject_type < 0) {
+            now.send(owner, false);
+            scoped_lock l(lock);
+            sent ++;
+            return true;
+        }
 
-    ~alert_callback_t() { }
+        {
+            scoped_lock l(lock);
+            pending_modify_t &m = modifies[order.get()];
+            if (m.order) {
+                if (m.fields != 0) {
+                    coalesced ++;
+                }
+                m.merge(fields, price, qty, trigger);
+                return false;
+            }
+            m.order = order;
+            m.sending = true;
+            in_flight = modifies.size();
+            sent ++;
+        }
 
-    void operator()(const zenfire::alert::alert_t& alert) {
-        env_attachment a;
+        send_modifies(now, false);
+        return true;
+    }
+
+    /**
+     * Called for every report: on the order's modify ack or reject, or once
+     * it has nothing open, ends its in-flight modify and hands the pending
+     * one, if any, to the throttle's sender thread, so the report thread
+     * never waits on a send. A failure goes to the owner.
+     */
+    void release(const zenfire::order_ptr &order, int type) {
+        if (in_flight == 0 || ! order) {
+            return;
+        }
+        bool done = order->open() == 0;
+        if (type != ack_type && type != reject_type && ! done) {
+            return;
+        }
 
-        jstring message = a.env()->NewStringUTF(alert.message().c_str());
+        pending_modify_t next;
+        {
+            scoped_lock l(lock);
+            map<const void *, pending_modify_t>::iterator it = modifies.find(order.get());
+            if (it == modifies.end()) {
+                return;
+            }
+            if (it->second.sending) {
+                it->second.acked = true;
+                return;
+            }
+            if (done || it->second.fields == 0) {
+                modifies.erase(it);
+                in_flight = modifies.size();
+                return;
+            }
+            next = it->second;
+            it->second.fields = 0;
+            it->second.sending = true;
+            sent ++;
+        }
 
-        a.env()->CallVoidMethod(obj.obj(),
-            invokeCallback_alert,
-            (jint) alert.type(),
-            (jint) alert.number(),
-            (jobject) message);
+        try {
+            send_modifies(next, true);
+        } catch (exception &ex) {
+            owner->queued_action_failed(order, THROTTLE_UPDATE, ex.what());
+        }
     }
-};
 
-class report_callback_t {
+    /** Ends the order's modify, dropping pending changes, when its update failed. */
+    void drop(const zenfire::order_ptr &order) {
+        if (in_flight == 0) {
+            return;
+        }
+        scoped_lock l(lock);
+        modifies.erase(order.get());
+        in_flight = modifies.size();
+    }
 
-    private:
-    global_ref obj;
+    /** The limit price the order will have once its pending modify is sent. */
+    double target_price(const zenfire::order_ptr &order) {
+        scoped_lock l(lock);
+        map<const void *, pending_modify_t>::iterator it = modifies.find(order.get());
+        if (it != modifies.end() && (it->second.fields & MODIFY_PRICE)) {
+            return it->second.price;
+        }
+        return order->price();
+    }
 
-    public:
-    report_callback_t(global_ref obj) : obj(obj) { }
+    /** Adds {modifies sent, modifies coalesced, orders with a modify in flight} to out. */
+    void stats(jlong out[3]) {
+        scoped_lock l(lock);
+        out[0] += sent;
+        out[1] += coalesced;
+        out[2] += modifies.size();
+    }
+};
 
-    ~report_callback_t() { }
+/**
+ * Collects callback data for a synchronous request. The request thread
+ * waits until nothing new has arrived for the quiet period, or until the
+ * timeout when nothing arrives at all. Arrivals are counted under the
+ * owning client state's lock.
+ *
+ * libzenfire marks neither replayed ticks nor replayed reports, so only
+ * data stamped before the request was made is known to be history; later
+ * data may be live and must still reach the callbacks.
+ */
+class capture_t {
+    private:
+    pthread_cond_t cond;
+    // a second of slack for feed latency
+    int live_from;
 
-    void operator()(const zenfire::report::report_t& report) {
-        env_attachment a;
+    capture_t(const capture_t &);
+    capture_t& operator=(const capture_t &);
 
-        jstring message = a.env()->NewStringUTF(report.message().c_str());
+    protected:
+    int arrivals;
 
-        a.env()->CallVoidMethod(obj.obj(),
-            invokeCallback_report,
-            (jint) report.typ_,
-            (jobject) message,
-            (jint) report.qty(),
-            (jdouble) report.price(),
-            (jlong) new zenfire::order_ptr(report.order),
-            ((jlong)report.ts) * 1000L + ((jlong)report.usec / 1000L), // millis
-            (((jint)report.usec) % 1000) * 1000 // nanos
-        );
+    void arrived() {
+        arrivals ++;
+        pthread_cond_signal(&cond);
     }
-};
 
-void throw_java(JNIEnv *env, exception *ex) {
-    jclass extype = ZenFireException;
-    if (dynamic_cast<zenfire::error::access_t*>(ex) != 0) {
-        extype = AccessException;
-    } else if (dynamic_cast<zenfire::error::connection_t*>(ex) != 0) {
-        extype = ConnectionException;
-    } else if (dynamic_cast<zenfire::error::timeout_t*>(ex) != 0) {
-        extype = TimeoutException;
-    } else if (dynamic_cast<zenfire::error::invalid_t*>(ex) != 0) {
-        extype = InvalidException;
-    } else if (dynamic_cast<zenfire::error::invalid_account_t*>(ex) != 0) {
-        extype = InvalidAccountException;
-    } else if (dynamic_cast<zenfire::error::invalid_product_t*>(ex) != 0) {
-        extype = InvalidInstrumentException;
-    } else if (dynamic_cast<zenfire::error::internal_t*>(ex) != 0) {
-        extype = InternalException;
-    }
-    const char *what = ex->what();
-    if (! what) {
-        what = "(no message)";
+    bool history(long ts) const {
+        return ts < live_from;
     }
-    env->ThrowNew(extype, what);
-}
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_init0(JNIEnv *env, jclass clazz) {
-    ClientImpl = clazz;
-    invokeCallback_tick = env->GetMethodID(clazz, "invokeCallback", "(IILjava/lang/String;Ljava/lang/String;JIDI)V");
-    invokeCallback_alert = env->GetMethodID(clazz, "invokeCallback", "(IILjava/lang/String;)V");
-    invokeCallback_report = env->GetMethodID(clazz, "invokeCallback", "(ILjava/lang/String;IDJJI)V");
-    OutOfMemoryError = (jclass) env->NewGlobalRef(env->FindClass("java/lang/OutOfMemoryError"));
-    AccessException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/AccessException"));
-    ConnectionException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/ConnectionException"));
-    TimeoutException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/TimeoutException"));
-    InvalidException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidException"));
-    InvalidAccountException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidAccountException"));
-    InvalidInstrumentException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidInstrumentException"));
-    InternalException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InternalException"));
-    ZenFireException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/ZenFireException"));
-    String = (jclass) env->NewGlobalRef(env->FindClass("java/lang/String"));
-    Instrument = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/Instrument"));
-    Instrument_init = env->GetMethodID(Instrument, "<init>", "(Ljava/lang/String;Ljava/lang/String;Ljava/math/BigDecimal;ILjzenfire/Instrument$Specification;)V");
-    Instrument_Specification = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/Instrument$Specification"));
-    Instrument_Specification_init = env->GetMethodID(Instrument_Specification, "<init>", "(ILjava/math/BigDecimal;Ljava/lang/String;Ljava/lang/String;)V");
-    BigDecimal = (jclass) env->NewGlobalRef(env->FindClass("java/math/BigDecimal"));
-    BigDecimal_init = env->GetMethodID(BigDecimal, "<init>", "(DLjava/math/MathContext;)V");
-    MathContext = (jclass) env->NewGlobalRef(env->FindClass("java/math/MathContext"));
-    MathContext_init = env->GetMethodID(MathContext, "<init>", "(I)V");
-}
+    public:
+    capture_t() : live_from((int) time(NULL) - 1), arrivals(0) { pthread_cond_init(&cond, NULL); }
+    virtual ~capture_t() { pthread_cond_destroy(&cond); }
+
+    static void add_millis(struct timespec &ts, long ms) {
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec ++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
 
-string to_string(JNIEnv *env, jstring jstr) {
-    if (jstr == NULL) {
-        return string("");
+    static bool before(const struct timespec &a, const struct timespec &b) {
+        return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
     }
-    const char *cchars = env->GetStringUTFChars(jstr, NULL);
-    string newstr(cchars, env->GetStringUTFLength(jstr));
-    env->ReleaseStringUTFChars(jstr, cchars);
-    return newstr;
-}
 
-string to_string(JNIEnv *env, jcharArray jca) {
-    int len = env->GetArrayLength(jca);
-    jchar *jca_chars = env->GetCharArrayElements(jca, NULL);
-    char chars[len+1];
-    for (int i = 0; i < len; i ++) {
-        // truncate to 8 bit chars
-        chars[i] = (char) jca_chars[i];
+    /** Call with lock held. */
+    void wait(mutex_t &lock, long quiet_ms, long timeout_ms) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        add_millis(deadline, timeout_ms);
+
+        for (;;) {
+            int seen = arrivals;
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            add_millis(until, quiet_ms);
+            if (seen == 0 || before(deadline, until)) {
+                until = deadline;
+            }
+            int rc = 0;
+            while (arrivals == seen && rc == 0) {
+                rc = pthread_cond_timedwait(&cond, lock.native(), &until);
+            }
+            if (arrivals == seen) {
+                // quiet period passed, or out of time
+                return;
+            }
+        }
     }
-    env->ReleaseCharArrayElements(jca, jca_chars, JNI_ABORT);
-    chars[len] = 0;
-    return string(chars);
-}
+};
 
-extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_create0(JNIEnv *env, jclass clazz, jobject clientImpl, jstring path) {
-    jlong ptr = 0L;
-    try {
-        zenfire::client::client_t *client = zenfire::client::create(to_string(env, path));
-        ptr = (jlong) client;
-        client->hook_alerts(alert_callback_t(global_ref(env, clientImpl)));
-        client->hook_reports(report_callback_t(global_ref(env, clientImpl)));
-        client->hook_ticks(tick_callback_t(global_ref(env, clientImpl)));
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return 0L;
+/**
+ * Historical ticks for one product and time range, returned in columns by
+ * replayTicksBulk0. History is held back from the tick callback. Ticks that
+ * may be live are captured while the range covers the present but still
+ * delivered as usual, and they do not hold off the quiet period.
+ */
+class tick_capture_t : public capture_t {
+    public:
+    string symbol;
+    int exchange;
+    int from;
+    int to;
+
+    vector<jlong> ts;
+    vector<jdouble> price;
+    vector<jint> size;
+    vector<jbyte> type;
+
+    tick_capture_t(const zenfire::product::product_t &prod, int from, int to)
+        : symbol(prod.symbol), exchange((int) prod.exchange), from(from), to(to) { }
+
+    /** Returns true if the tick is to be held back. Call with the owning state's lock held. */
+    bool offer(const zenfire::tick::tick_t &tick) {
+        if (tick.ts < from || tick.ts > to
+            || (int) tick.product->exchange != exchange
+            || tick.product->symbol != symbol) {
+            return false;
+        }
+        ts.push_back(((jlong)tick.ts) * 1000000L + (jlong)tick.usec);
+        price.push_back((jdouble) tick.price);
+        size.push_back((jint) tick.size);
+        type.push_back((jbyte) tick.typ_);
+        if (! history(tick.ts)) {
+            return false;
+        }
+        arrived();
+        return true;
     }
-    return ptr;
-}
+};
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_free0(JNIEnv *env, jclass clazz, jlong ptr) {
-    delete ((zenfire::client_t *)ptr);
-}
+/**
+ * Reports for one account, gathered while a snapshot native runs. Reports
+ * that carry no order, such as P&L and position replies, are taken as
+ * belonging to the account asked for. Only history is captured, and it is
+ * held back from the report callback; anything that may be live, such as a
+ * fill arriving mid-snapshot, is delivered as usual and neither lands in
+ * the snapshot nor holds off the quiet period.
+ */
+class report_capture_t : public capture_t {
+    public:
+    string account;
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_login0(
-    JNIEnv *env,
-    jclass clazz,
-    jlong ptr,
-    jstring user,
-    jcharArray passwd,
-    jstring environment) {
+    vector<jint> type;
+    vector<jint> qty;
+    vector<jdouble> price;
+    vector<jlong> order;
+    vector<jlong> ts;
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    throttle_owner_t *owner;
 
-    string user_str = to_string(env, user);
-    string environment_str = to_string(env, environment);
-    string passwd_str = to_string(env, passwd);
+    report_capture_t(const string &account, throttle_owner_t *owner) : account(account), owner(owner) { }
 
-    try {
-        zf->login(user_str, passwd_str, environment_str);
-    } catch (exception &ex) {
-        throw_java(env, &ex);
+    ~report_capture_t() {
+        // handles not passed on to Java
+        for (size_t i = 0; i < order.size(); i ++) {
+            delete (order_handle_t *) order[i];
+        }
     }
 
-}
+    /** Returns true if the report is to be held back. Call with the owning state's lock held. */
+    bool offer(const zenfire::report::report_t &report) {
+        if (! history(report.ts) || (report.order && report.order->acct() != account)) {
+            return false;
+        }
+        type.push_back((jint) report.typ_);
+        qty.push_back((jint) report.qty());
+        price.push_back((jdouble) report.price());
+        order.push_back(report.order ? (jlong) new order_handle_t(report.order, owner, report.message()) : 0L);
+        ts.push_back(((jlong)report.ts) * 1000000L + (jlong)report.usec);
+        arrived();
+        return true;
+    }
+};
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_logout0(JNIEnv *env, jclass clazz, jlong ptr) {
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+/** Order types as placeOrder0 takes them and orderGetType0 returns them. */
+enum order_type_t {
+    ORDER_MARKET = 1,
+    ORDER_LIMIT = 2,
+    ORDER_STOP_MARKET = 3,
+    ORDER_STOP_LIMIT = 4
+};
 
-    try {
-        zf->logout();
-    } catch (exception &ex) {
-        throw_java(env, &ex);
+/**
+ * Selects live orders for mass actions. Empty strings and a negative side
+ * match anything; limit_only leaves out orders without a limit price.
+ */
+class order_filter_t {
+    public:
+    string acct;
+    string symbol;
+    string exchange;
+    int side;
+    string tag;
+    string zentag;
+    bool limit_only;
+
+    order_filter_t() : side(-1), limit_only(false) { }
+
+    bool matches(const zenfire::order::order_t &order) const {
+        if (limit_only && order.type() != ORDER_LIMIT && order.type() != ORDER_STOP_LIMIT) return false;
+        if (side >= 0 && order.action() != side) return false;
+        if (! acct.empty() && order.acct() != acct) return false;
+        if (! symbol.empty() && order.product().symbol != symbol) return false;
+        if (! exchange.empty() && zenfire::exchange::to_string(order.product().exchange) != exchange) return false;
+        if (! tag.empty() && order.tag() != tag) return false;
+        if (! zentag.empty() && order.zentag() != zentag) return false;
+        return true;
     }
-}
-
-extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_getOption0(
-    JNIEnv *env,
-    jclass clazz,
-    jlong ptr,
-    jstring option) {
+};
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+/*
+ * Callback data copied out of libzenfire's structures, so it can be
+ * delivered later by a dispatcher as well as right away. deliver() makes
+ * the upcall; the caller checks for exceptions.
+ */
+struct tick_event_t {
+    jint type;
+    string symbol;
+    string exchange;
+    jlong millis;
+    jint nanos;
+    bool in_ticks;
+    jlong ticks;
+    jdouble price;
+    jint size;
+};
 
-    string option_str = to_string(env, option);
+struct alert_event_t {
+    jint type;
+    jint number;
+    string message;
+};
 
-    try {
-        return (jint) zf->option(option_str);
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return 0;
-    }
-}
+struct report_event_t {
+    jint type;
+    string message;
+    jint qty;
+    jdouble price;
+    zenfire::order_ptr order;
+    throttle_owner_t *owner;
+    jlong millis;
+    jint nanos;
+    bool lazy;
+};
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_setOption0(
-    JNIEnv *env,
-    jclass clazz,
-    jlong ptr,
-    jstring option,
-    jint value) {
+/** The tick upcall itself, for callers that have no tick_event_t to hand. */
+void deliver_tick(JNIEnv *env, jobject obj, jint type, const char *symbol_chars, const char *exchange_chars,
+    jlong millis, jint nanos, bool in_ticks, jlong ticks, jdouble price, jint size) {
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    TRACE_SCOPE("upcall.tick");
 
-    string option_str = to_string(env, option);
+    jstring symbol = env->NewStringUTF(symbol_chars);
+    jstring exchange = env->NewStringUTF(exchange_chars);
 
-    try {
-        zf->option(option_str, value);
-    } catch (exception &ex) {
-        throw_java(env, &ex);
+    if (in_ticks) {
+        env->CallVoidMethod(obj,
+            invokeCallback_tick_ticks,
+            type,
+            (jint) 0,
+            (jobject) symbol,
+            (jobject) exchange,
+            millis,
+            nanos,
+            ticks,
+            size);
+    } else {
+        env->CallVoidMethod(obj,
+            invokeCallback_tick,
+            type,
+            (jint) 0,
+            (jobject) symbol,
+            (jobject) exchange,
+            millis,
+            nanos,
+            price,
+            size);
     }
+
+    env->DeleteLocalRef(symbol);
+    env->DeleteLocalRef(exchange);
 }
 
-extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_getEnvironments0(
-    JNIEnv *env,
-    jclass clazz,
-    jlong ptr) {
+void deliver(JNIEnv *env, jobject obj, const tick_event_t &ev) {
+    deliver_tick(env, obj, ev.type, ev.symbol.c_str(), ev.exchange.c_str(),
+        ev.millis, ev.nanos, ev.in_ticks, ev.ticks, ev.price, ev.size);
+}
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+void deliver(JNIEnv *env, jobject obj, const alert_event_t &ev) {
+    TRACE_SCOPE("upcall.alert");
 
-    vector<string> envvec;
+    jstring message = env->NewStringUTF(ev.message.c_str());
 
-    try {
-        envvec = zf->list_environments();
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return NULL;
+    env->CallVoidMethod(obj,
+        invokeCallback_alert,
+        ev.type,
+        ev.number,
+        (jobject) message);
+
+    env->DeleteLocalRef(message);
+}
+
+void deliver(JNIEnv *env, jobject obj, const report_event_t &ev) {
+    TRACE_SCOPE("upcall.report");
+
+    if (ev.lazy) {
+        jlong order = (jlong) new order_handle_t(ev.order, ev.owner, ev.message);
+
+        env->CallVoidMethod(obj,
+            invokeCallback_report_lazy,
+            ev.type,
+            ev.qty,
+            ev.price,
+            order,
+            ev.millis,
+            ev.nanos);
+        return;
     }
 
-    int len = envvec.size();
+    jlong order = (jlong) new order_handle_t(ev.order, ev.owner);
+    jstring message = env->NewStringUTF(ev.message.c_str());
+
+    env->CallVoidMethod(obj,
+        invokeCallback_report,
+        ev.type,
+        (jobject) message,
+        ev.qty,
+        ev.price,
+        order,
+        ev.millis,
+        ev.nanos);
+
+    env->DeleteLocalRef(message);
+}
+
+/**
+ * A queue of one class of event awaiting the dispatcher, with its backlog
+ * and queueing latency (enqueue to the start of delivery). A lane with a
+ * capacity drops its oldest event to make room for a new one.
+ */
+template <typename event_t>
+class event_lane_t {
+    private:
+    mutex_t lock;
+    deque<pair<jlong, event_t> > queue;
+    size_t capacity_;
+    jlong delivered;
+    jlong dropped_;
+    jlong max_backlog;
+    jlong latency_ns;
+    jlong max_latency_ns;
+
+    event_lane_t(const event_lane_t &);
+    event_lane_t& operator=(const event_lane_t &);
+
+    public:
+    /** capacity 0 for unbounded */
+    event_lane_t(size_t capacity = 0)
+        : capacity_(capacity), delivered(0), dropped_(0), max_backlog(0), latency_ns(0), max_latency_ns(0) { }
+
+    size_t capacity() {
+        scoped_lock l(lock);
+        return capacity_;
+    }
+
+    void capacity(size_t capacity) {
+        scoped_lock l(lock);
+        capacity_ = capacity;
+        while (capacity_ > 0 && queue.size() > capacity_) {
+            queue.pop_front();
+            dropped_ ++;
+        }
+    }
+
+    jlong dropped() {
+        scoped_lock l(lock);
+        return dropped_;
+    }
+
+    void push(const event_t &ev) {
+        scoped_lock l(lock);
+        if (capacity_ > 0 && queue.size() >= capacity_) {
+            queue.pop_front();
+            dropped_ ++;
+        }
+        queue.push_back(make_pair(monotonic_ns(), ev));
+        if ((jlong) queue.size() > max_backlog) {
+            max_backlog = queue.size();
+        }
+    }
+
+    bool pop(event_t &ev) {
+        scoped_lock l(lock);
+        if (queue.empty()) {
+            return false;
+        }
+        jlong latency = monotonic_ns() - queue.front().first;
+        ev = queue.front().second;
+        queue.pop_front();
+        delivered ++;
+        latency_ns += latency;
+        if (latency > max_latency_ns) {
+            max_latency_ns = latency;
+        }
+        return true;
+    }
+
+    void clear() {
+        scoped_lock l(lock);
+        queue.clear();
+    }
+
+    /** {backlog, max backlog, delivered, mean latency ns, max latency ns} */
+    void stats(jlong out[5]) {
+        scoped_lock l(lock);
+        out[0] = queue.size();
+        out[1] = max_backlog;
+        out[2] = delivered;
+        out[3] = delivered > 0 ? latency_ns / delivered : 0;
+        out[4] = max_latency_ns;
+    }
+};
+
+/**
+ * Delivers a client's callbacks from its own thread, placed as a dispatch
+ * thread, in strict priority: any queued report goes before any alert, and
+ * any alert before any tick, so a fill is never stuck behind a burst of
+ * market data. Events within a lane keep their order. Reports and alerts
+ * are never dropped; the tick lane holds at most jzenfire.tick_lane_capacity
+ * ticks and drops the oldest when a slow consumer lets it fill.
+ */
+class dispatcher_t {
+    private:
+    global_ref obj;
+    event_lane_t<report_event_t> reports;
+    event_lane_t<alert_event_t> alerts;
+    event_lane_t<tick_event_t> ticks;
+    signal_t signal;
+    volatile int stopping;
+    bool running;
+    pthread_t thread;
+    mutex_t control;
+
+    dispatcher_t(const dispatcher_t &);
+    dispatcher_t& operator=(const dispatcher_t &);
+
+    static void *run(void *self) {
+        ((dispatcher_t *) self)->loop();
+        return NULL;
+    }
+
+    template <typename event_t>
+    bool deliver_one(JNIEnv *env, event_lane_t<event_t> &lane) {
+        event_t ev;
+        if (! lane.pop(ev)) {
+            return false;
+        }
+        deliver(env, obj.obj(), ev);
+        if (env->ExceptionCheck()) {
+            // nothing above us to throw to
+            env->ExceptionDescribe();
+        }
+        return true;
+    }
+
+    void loop() {
+        env_attachment a;
+        for (;;) {
+            dispatch_threads.enter();
+            uint32_t seen = signal.current();
+            if (deliver_one(a.env(), reports)
+                || deliver_one(a.env(), alerts)
+                || deliver_one(a.env(), ticks)) {
+                continue;
+            }
+            if (stopping) {
+                break;
+            }
+            signal.wait(seen, 0);
+        }
+    }
+
+    public:
+    dispatcher_t(const global_ref &obj) : obj(obj), ticks(65536), stopping(0), running(false) { }
+
+    ~dispatcher_t() {
+        reports.clear();
+        alerts.clear();
+        ticks.clear();
+        stop();
+    }
+
+    void start() {
+        scoped_lock l(control);
+        if (running) {
+            return;
+        }
+        stopping = 0;
+        if (pthread_create(&thread, NULL, run, this) != 0) {
+            throw std::runtime_error("Failed to start dispatcher thread");
+        }
+        running = true;
+    }
+
+    /** Delivers what is queued, then stops the thread. */
+    void stop() {
+        scoped_lock l(control);
+        if (! running) {
+            return;
+        }
+        if (pthread_equal(pthread_self(), thread)) {
+            // it would be joining itself
+            throw std::runtime_error("jzenfire.dispatch cannot be cleared from a dispatched callback");
+        }
+        stopping = 1;
+        signal.notify();
+        pthread_join(thread, NULL);
+        running = false;
+    }
+
+    void push(const report_event_t &ev) { reports.push(ev); signal.notify(); }
+    void push(const alert_event_t &ev) { alerts.push(ev); signal.notify(); }
+    void push(const tick_event_t &ev) { ticks.push(ev); signal.notify(); }
+
+    size_t tick_capacity() { return ticks.capacity(); }
+    void tick_capacity(size_t capacity) { ticks.capacity(capacity); }
+
+    /**
+     * Five values per lane as event_lane_t::stats, reports, alerts, ticks,
+     * then the number of ticks dropped.
+     */
+    void stats(jlong out[16]) {
+        reports.stats(out);
+        alerts.stats(out + 5);
+        ticks.stats(out + 10);
+        out[15] = ticks.dropped();
+    }
+};
+
+class order_pools_t;
+class client_state_t;
+void free_order_pools(client_state_t *state);
+void action_failed(client_state_t *state, const zenfire::order_ptr &order, const string &what);
+
+/**
+ * Alert type for an order action that failed without the native that asked
+ * for it throwing: one the binding performed on the client's behalf after
+ * the native returned, or one order of a mass action. The alert number is
+ * the order number and the message the error.
+ */
+const jint ALERT_ACTION_FAILED = -1;
+
+/**
+ * Binding-side state for one client, shared by its callbacks. It owns the
+ * client's orders in the throttle, and so hears of its queued actions that
+ * failed.
+ *
+ * Options under the "jzenfire." prefix are handled here instead of being
+ * passed on to libzenfire.
+ */
+class client_state_t : public throttle_owner_t {
+    public:
+    global_ref obj;
+    volatile int lazy_reports;
+    volatile int tick_units;
+    shm_tick_writer *volatile shm_writer;
+    // tick callbacks between taking shm_writer and finishing with it
+    volatile int shm_publishing;
+    tick_archive_writer *volatile archive_writer;
+    tick_capture_t *volatile tick_capture;
+    report_capture_t *volatile report_capture;
+    volatile int replay_quiet_ms;
+    volatile int snapshot_quiet_ms;
+
+    // archive writers replaced while callbacks may still be using them,
+    // freed with the state
+    vector<tick_archive_writer *> retired_archives;
+    // orders placed through this client or seen in its reports, until
+    // nothing is left open
+    map<const void *, zenfire::order_ptr> live_orders;
+    synthetic_book synthetics;
+    // created by the first poolCreate0; uses the client, so free0 deletes
+    // it before the client
+    order_pools_t *pools;
+    modify_coalescer_t coalescer;
+    // callbacks go through the dispatcher's lanes while dispatch is set
+    dispatcher_t *dispatcher;
+    volatile int dispatch;
+    mutex_t lock;
+
+    client_state_t(const global_ref &obj)
+        : obj(obj), lazy_reports(0), tick_units(0), shm_writer(NULL), shm_publishing(0), archive_writer(NULL),
+          tick_capture(NULL), report_capture(NULL),
+          replay_quiet_ms(500), snapshot_quiet_ms(500), pools(NULL), coalescer(this),
+          dispatcher(new dispatcher_t(obj)), dispatch(0) { }
+
+    ~client_state_t() {
+        delete dispatcher;
+        if (shm_writer != NULL) {
+            shm_writer->unlink();
+        }
+        delete shm_writer;
+        delete archive_writer;
+        for (size_t i = 0; i < retired_archives.size(); i ++) {
+            delete retired_archives[i];
+        }
+    }
+
+    void queued_action_failed(const zenfire::order_ptr &order, throttle_op_t op, const string &what) {
+        if (op == THROTTLE_UPDATE) {
+            // no ack will come for it
+            coalescer.drop(order);
+        }
+        action_failed(this, order, what);
+    }
+
+    /** Delivers an alert raised by the binding itself. */
+    void alert(const alert_event_t &ev) {
+        if (dispatch) {
+            dispatcher->push(ev);
+            return;
+        }
+        env_attachment a;
+        deliver(a.env(), obj.obj(), ev);
+        if (a.env()->ExceptionCheck()) {
+            a.env()->ExceptionDescribe();
+        }
+    }
+
+    /**
+     * Replaces the writer. The old one is unmapped as soon as no tick
+     * callback can still be publishing to it, which is at most one publish.
+     */
+    void publish_ticks(shm_tick_writer *writer) {
+        shm_tick_writer *old;
+        {
+            scoped_lock l(lock);
+            old = shm_writer;
+            shm_writer = writer;
+        }
+        if (old == NULL) {
+            return;
+        }
+        // a ring republished under the same name has its own inode, so
+        // this only removes the name when nothing replaced it
+        old->unlink();
+        // callbacks counted from now on see the new writer
+        __sync_synchronize();
+        while (shm_publishing != 0) {
+            sched_yield();
+        }
+        delete old;
+    }
+
+    /** Returns the writer replaced, which the caller should close. */
+    tick_archive_writer *archive_ticks(tick_archive_writer *writer) {
+        scoped_lock l(lock);
+        tick_archive_writer *old = archive_writer;
+        if (old != NULL) {
+            retired_archives.push_back(old);
+        }
+        archive_writer = writer;
+        return old;
+    }
+
+    void track_order(const zenfire::order_ptr &order, bool placed) {
+        if (! order) {
+            return;
+        }
+        bool open = placed || order->open() > 0;
+        scoped_lock l(lock);
+        if (open) {
+            live_orders[order.get()] = order;
+        } else {
+            live_orders.erase(order.get());
+        }
+    }
+
+    void select_orders(const order_filter_t &filter, vector<zenfire::order_ptr> &out) {
+        scoped_lock l(lock);
+        for (map<const void *, zenfire::order_ptr>::iterator it = live_orders.begin(); it != live_orders.end(); ++ it) {
+            if (filter.matches(*it->second)) {
+                out.push_back(it->second);
+            }
+        }
+    }
+
+    bool has_option(const string &option) {
+        return option.compare(0, 9, "jzenfire.") == 0;
+    }
+
+    int option(const string &option) {
+        int value;
+        if (get_thread_option(option, value)) return value;
+        if (get_trace_option(option, value)) return value;
+        if (option == "jzenfire.lazy_reports") return lazy_reports;
+        if (option == "jzenfire.tick_units") return tick_units;
+        if (option == "jzenfire.replay_quiet_ms") return replay_quiet_ms;
+        if (option == "jzenfire.snapshot_quiet_ms") return snapshot_quiet_ms;
+        if (option == "jzenfire.natives_registered") return natives_registered;
+        if (option == "jzenfire.dispatch") return dispatch;
+        if (option == "jzenfire.tick_lane_capacity") return (int) dispatcher->tick_capacity();
+        if (option == "jzenfire.modify_ack_type") return coalescer.ack_type;
+        if (option == "jzenfire.modify_reject_type") return coalescer.reject_type;
+        throw std::invalid_argument("Unknown option " + option);
+    }
+
+    void option(const string &option, int value) {
+        if (set_thread_option(option, value) || set_trace_option(option, value)) {
+            return;
+        } else if (option == "jzenfire.lazy_reports") {
+            if (value && invokeCallback_report_lazy == NULL) {
+                throw std::runtime_error("ClientImpl has no primitive report callback");
+            }
+            lazy_reports = value;
+        } else if (option == "jzenfire.tick_units") {
+            if (value && invokeCallback_tick_ticks == NULL) {
+                throw std::runtime_error("ClientImpl has no tick unit tick callback");
+            }
+            tick_units = value;
+        } else if (option == "jzenfire.replay_quiet_ms") {
+            if (value <= 0) {
+                throw std::invalid_argument("jzenfire.replay_quiet_ms must be positive");
+            }
+            replay_quiet_ms = value;
+        } else if (option == "jzenfire.dispatch") {
+            if (value) {
+                dispatcher->start();
+                dispatch = 1;
+            } else {
+                bool was = dispatch != 0;
+                dispatch = 0;
+                try {
+                    dispatcher->stop();
+                } catch (exception &) {
+                    dispatch = was;
+                    throw;
+                }
+            }
+        } else if (option == "jzenfire.tick_lane_capacity") {
+            if (value <= 0) {
+                throw std::invalid_argument("jzenfire.tick_lane_capacity must be positive");
+            }
+            dispatcher->tick_capacity((size_t) value);
+        } else if (option == "jzenfire.modify_ack_type") {
+            coalescer.ack_type = value;
+        } else if (option == "jzenfire.modify_reject_type") {
+            coalescer.reject_type = value;
+        } else if (option == "jzenfire.snapshot_quiet_ms") {
+            if (value <= 0) {
+                throw std::invalid_argument("jzenfire.snapshot_quiet_ms must be positive");
+            }
+            snapshot_quiet_ms = value;
+        } else {
+            throw std::invalid_argument("Unknown option " + option);
+        }
+    }
+};
+
+mutex_t client_states_lock;
+map<zenfire::client_t *, client_state_t *> client_states;
+
+void action_failed(client_state_t *state, const zenfire::order_ptr &order, const string &what) {
+    alert_event_t ev;
+    ev.type = ALERT_ACTION_FAILED;
+    ev.number = (jint) order->number();
+    ev.message = what;
+    state->alert(ev);
+}
+
+client_state_t *client_state(zenfire::client_t *zf) {
+    scoped_lock l(client_states_lock);
+    map<zenfire::client_t *, client_state_t *>::iterator it = client_states.find(zf);
+    if (it == client_states.end()) {
+        throw std::runtime_error("Unknown client");
+    }
+    return it->second;
+}
+
+/**
+ * Price <-> tick count conversion for the tick unit pricing mode, using the
+ * product's increment. Prices made from ticks are rounded to the product's
+ * precision so they go out without binary noise.
+ */
+jlong to_ticks(double price, const zenfire::product::product_t &prod) {
+    if (prod.increment <= 0.0) {
+        throw std::invalid_argument("Instrument " + prod.symbol + " has no tick increment");
+    }
+    return (jlong) floor(price / prod.increment + 0.5);
+}
+
+double from_ticks(jlong ticks, const zenfire::product::product_t &prod) {
+    if (prod.increment <= 0.0) {
+        throw std::invalid_argument("Instrument " + prod.symbol + " has no tick increment");
+    }
+    double price = (double) ticks * prod.increment;
+    double scale = pow(10.0, (double) prod.precision);
+    return floor(price * scale + 0.5) / scale;
+}
+
+class tick_callback_t {
+
+    private:
+    global_ref obj;
+    client_state_t *state;
+
+    public:
+    tick_callback_t(global_ref obj, client_state_t *state) : obj(obj), state(state) {}
+
+    ~tick_callback_t() { }
+
+    void operator()(const zenfire::tick::tick_t& tick) {
+        callback_threads.enter();
+        TRACE_SCOPE("tick_callback");
+
+        if (state->shm_writer != NULL) {
+            string exchange = zenfire::exchange::to_string(tick.product->exchange);
+            // counted so publish_ticks knows when a replaced writer is free
+            __sync_add_and_fetch(&state->shm_publishing, 1);
+            shm_tick_writer *writer = state->shm_writer;
+            if (writer != NULL) {
+                writer->publish(tick.typ_,
+                    ((int64_t)tick.ts) * 1000000 + (int64_t)tick.usec,
+                    tick.price,
+                    tick.size,
+                    tick.product->symbol,
+                    exchange);
+            }
+            __sync_sub_and_fetch(&state->shm_publishing, 1);
+        }
+
+        tick_archive_writer *archive = state->archive_writer;
+        if (archive != NULL) {
+            archive->append(tick.product->symbol,
+                zenfire::exchange::to_string(tick.product->exchange),
+                tick.product->increment,
+                tick.product->precision,
+                ((int64_t)tick.ts) * 1000000 + (int64_t)tick.usec,
+                tick.price,
+                tick.size,
+                (int8_t) tick.typ_);
+        }
+
+        if (state->tick_capture != NULL) {
+            scoped_lock l(state->lock);
+            if (state->tick_capture != NULL && state->tick_capture->offer(tick)) {
+                return;
+            }
+        }
+
+        bool suppress = false;
+        vector<synthetic_tick> implied;
+        if (! state->synthetics.empty()) {
+            suppress = state->synthetics.tick(tick.product->symbol,
+                zenfire::exchange::to_string(tick.product->exchange),
+                tick.typ_,
+                ((int64_t)tick.ts) * 1000000 + (int64_t)tick.usec,
+                tick.price,
+                tick.size,
+                implied);
+        }
+
+        jlong millis = ((jlong)tick.ts) * 1000L + ((jlong)tick.usec / 1000L);
+        jint nanos = (((jint)tick.usec) % 1000) * 1000;
+        bool in_ticks = state->tick_units && tick.product->increment > 0.0;
+        jlong ticks = in_ticks ? to_ticks(tick.price, *tick.product) : 0;
+
+        if (state->dispatch) {
+            for (size_t i = 0; i < implied.size(); i ++) {
+                state->dispatcher->push(implied_event(implied[i], state->tick_units != 0));
+            }
+            if (! suppress) {
+                // copied only here; the direct path makes the upcall from the tick
+                tick_event_t ev;
+                ev.type = (jint) tick.typ_;
+                ev.symbol = tick.product->symbol;
+                ev.exchange = zenfire::exchange::to_string(tick.product->exchange);
+                ev.millis = millis;
+                ev.nanos = nanos;
+                ev.in_ticks = in_ticks;
+                ev.ticks = ticks;
+                ev.price = (jdouble) tick.price;
+                ev.size = (jint) tick.size;
+                state->dispatcher->push(ev);
+            }
+            return;
+        }
+
+        env_attachment a;
+
+        for (size_t i = 0; i < implied.size(); i ++) {
+            deliver(a.env(), obj.obj(), implied_event(implied[i], state->tick_units != 0));
+        }
+        if (! suppress) {
+            deliver_tick(a.env(), obj.obj(),
+                (jint) tick.typ_,
+                tick.product->symbol.c_str(),
+                zenfire::exchange::to_string(tick.product->exchange).c_str(),
+                millis,
+                nanos,
+                in_ticks,
+                ticks,
+                (jdouble) tick.price,
+                (jint) tick.size);
+        }
+    }
+
+    static tick_event_t implied_event(const synthetic_tick &t, bool tick_units) {
+        tick_event_t ev;
+        ev.type = (jint) t.type;
+        ev.symbol = t.symbol;
+        ev.exchange = t.exchange;
+        ev.millis = (jlong) (t.ts / 1000);
+        ev.nanos = (jint) (t.ts % 1000) * 1000;
+        ev.in_ticks = tick_units && t.increment > 0.0;
+        ev.ticks = ev.in_ticks ? (jlong) floor(t.price / t.increment + 0.5) : 0;
+        ev.price = (jdouble) t.price;
+        ev.size = (jint) t.size;
+        return ev;
+    }
+};
+
+class alert_callback_t {
+
+    private:
+    global_ref obj;
+    client_state_t *state;
+
+    public:
+    alert_callback_t(global_ref obj, client_state_t *state) : obj(obj), state(state) {}
+
+    ~alert_callback_t() { }
+
+    void operator()(const zenfire::alert::alert_t& alert) {
+        callback_threads.enter();
+        TRACE_SCOPE("alert_callback");
+
+        alert_event_t ev;
+        ev.type = (jint) alert.type();
+        ev.number = (jint) alert.number();
+        ev.message = alert.message();
+
+        if (state->dispatch) {
+            state->dispatcher->push(ev);
+            return;
+        }
+
+        env_attachment a;
+        deliver(a.env(), obj.obj(), ev);
+    }
+};
+
+class report_callback_t {
+
+    private:
+    global_ref obj;
+    client_state_t *state;
+
+    public:
+    report_callback_t(global_ref obj, client_state_t *state) : obj(obj), state(state) { }
+
+    ~report_callback_t() { }
+
+    void operator()(const zenfire::report::report_t& report) {
+        callback_threads.enter();
+        TRACE_SCOPE("report_callback");
+
+        state->coalescer.release(report.order, (int) report.typ_);
+        state->track_order(report.order, false);
+
+        if (state->report_capture != NULL) {
+            scoped_lock l(state->lock);
+            if (state->report_capture != NULL && state->report_capture->offer(report)) {
+                return;
+            }
+        }
+
+        report_event_t ev;
+        ev.type = (jint) report.typ_;
+        ev.message = report.message();
+        ev.qty = (jint) report.qty();
+        ev.price = (jdouble) report.price();
+        ev.order = report.order;
+        ev.owner = state;
+        ev.millis = ((jlong)report.ts) * 1000L + ((jlong)report.usec / 1000L);
+        ev.nanos = (((jint)report.usec) % 1000) * 1000;
+        ev.lazy = state->lazy_reports != 0;
+
+        if (state->dispatch) {
+            state->dispatcher->push(ev);
+            return;
+        }
+
+        env_attachment a;
+        deliver(a.env(), obj.obj(), ev);
+    }
+};
+
+void throw_java(JNIEnv *env, exception *ex) {
+    jclass extype = ZenFireException;
+    if (dynamic_cast<zenfire::error::access_t*>(ex) != 0) {
+        extype = AccessException;
+    } else if (dynamic_cast<zenfire::error::connection_t*>(ex) != 0) {
+        extype = ConnectionException;
+    } else if (dynamic_cast<zenfire::error::timeout_t*>(ex) != 0) {
+        extype = TimeoutException;
+    } else if (dynamic_cast<zenfire::error::invalid_t*>(ex) != 0) {
+        extype = InvalidException;
+    } else if (dynamic_cast<zenfire::error::invalid_account_t*>(ex) != 0) {
+        extype = InvalidAccountException;
+    } else if (dynamic_cast<zenfire::error::invalid_product_t*>(ex) != 0) {
+        extype = InvalidInstrumentException;
+    } else if (dynamic_cast<zenfire::error::internal_t*>(ex) != 0) {
+        extype = InternalException;
+    } else if (dynamic_cast<std::invalid_argument*>(ex) != 0) {
+        extype = InvalidException;
+    } else if (dynamic_cast<std::bad_alloc*>(ex) != 0) {
+        extype = OutOfMemoryError;
+    }
+    const char *what = ex->what();
+    if (! what) {
+        what = "(no message)";
+    }
+    env->ThrowNew(extype, what);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_init0(JNIEnv *env, jclass clazz) {
+    TRACE_SCOPE("init0");
+    ClientImpl = clazz;
+    invokeCallback_tick = env->GetMethodID(clazz, "invokeCallback", "(IILjava/lang/String;Ljava/lang/String;JIDI)V");
+    // optional: as above with the price as a long tick count
+    invokeCallback_tick_ticks = env->GetMethodID(clazz, "invokeCallback", "(IILjava/lang/String;Ljava/lang/String;JIJI)V");
+    if (invokeCallback_tick_ticks == NULL) {
+        env->ExceptionClear();
+    }
+    invokeCallback_alert = env->GetMethodID(clazz, "invokeCallback", "(IILjava/lang/String;)V");
+    invokeCallback_report = env->GetMethodID(clazz, "invokeCallback", "(ILjava/lang/String;IDJJI)V");
+    // optional: (type, qty, price, order, millis, nanos), message fetched by reportGetMessage0
+    invokeCallback_report_lazy = env->GetMethodID(clazz, "invokeCallback", "(IIDJJI)V");
+    if (invokeCallback_report_lazy == NULL) {
+        env->ExceptionClear();
+    }
+    OutOfMemoryError = (jclass) env->NewGlobalRef(env->FindClass("java/lang/OutOfMemoryError"));
+    AccessException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/AccessException"));
+    ConnectionException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/ConnectionException"));
+    TimeoutException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/TimeoutException"));
+    InvalidException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidException"));
+    InvalidAccountException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidAccountException"));
+    InvalidInstrumentException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InvalidInstrumentException"));
+    InternalException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/InternalException"));
+    ZenFireException = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/ZenFireException"));
+    String = (jclass) env->NewGlobalRef(env->FindClass("java/lang/String"));
+    Object = (jclass) env->NewGlobalRef(env->FindClass("java/lang/Object"));
+    Instrument = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/Instrument"));
+    Instrument_init = env->GetMethodID(Instrument, "<init>", "(Ljava/lang/String;Ljava/lang/String;Ljava/math/BigDecimal;ILjzenfire/Instrument$Specification;)V");
+    Instrument_Specification = (jclass) env->NewGlobalRef(env->FindClass("jzenfire/Instrument$Specification"));
+    Instrument_Specification_init = env->GetMethodID(Instrument_Specification, "<init>", "(ILjava/math/BigDecimal;Ljava/lang/String;Ljava/lang/String;)V");
+    BigDecimal = (jclass) env->NewGlobalRef(env->FindClass("java/math/BigDecimal"));
+    BigDecimal_init = env->GetMethodID(BigDecimal, "<init>", "(DLjava/math/MathContext;)V");
+    MathContext = (jclass) env->NewGlobalRef(env->FindClass("java/math/MathContext"));
+    MathContext_init = env->GetMethodID(MathContext, "<init>", "(I)V");
+}
+
+string to_string(JNIEnv *env, jstring jstr) {
+    if (jstr == NULL) {
+        return string("");
+    }
+    const char *cchars = env->GetStringUTFChars(jstr, NULL);
+    string newstr(cchars, env->GetStringUTFLength(jstr));
+    env->ReleaseStringUTFChars(jstr, cchars);
+    return newstr;
+}
+
+string to_string(JNIEnv *env, jcharArray jca) {
+    int len = env->GetArrayLength(jca);
+    jchar *jca_chars = env->GetCharArrayElements(jca, NULL);
+    char chars[len+1];
+    for (int i = 0; i < len; i ++) {
+        // truncate to 8 bit chars
+        chars[i] = (char) jca_chars[i];
+    }
+    env->ReleaseCharArrayElements(jca, jca_chars, JNI_ABORT);
+    chars[len] = 0;
+    return string(chars);
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_create0(JNIEnv *env, jclass clazz, jobject clientImpl, jstring path) {
+    TRACE_SCOPE("create0");
+    jlong ptr = 0L;
+    try {
+        zenfire::client::client_t *client = zenfire::client::create(to_string(env, path));
+        ptr = (jlong) client;
+        client_state_t *state = new client_state_t(global_ref(env, clientImpl));
+        {
+            scoped_lock l(client_states_lock);
+            client_states[client] = state;
+        }
+        client->hook_alerts(alert_callback_t(global_ref(env, clientImpl), state));
+        client->hook_reports(report_callback_t(global_ref(env, clientImpl), state));
+        client->hook_ticks(tick_callback_t(global_ref(env, clientImpl), state));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
+    }
+    return ptr;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_free0(JNIEnv *env, jclass clazz, jlong ptr) {
+    TRACE_SCOPE("free0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    client_state_t *state = NULL;
+    {
+        scoped_lock l(client_states_lock);
+        map<zenfire::client_t *, client_state_t *>::iterator it = client_states.find(zf);
+        if (it != client_states.end()) {
+            state = it->second;
+            client_states.erase(it);
+        }
+    }
+    if (state != NULL) {
+        free_order_pools(state);
+        // queued actions use the client's orders
+        throttle.forget(state);
+    }
+    // the client owns the callbacks referring to state, so it goes first
+    delete zf;
+    delete state;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_login0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring user,
+    jcharArray passwd,
+    jstring environment) {
+
+    TRACE_SCOPE("login0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    string user_str = to_string(env, user);
+    string environment_str = to_string(env, environment);
+    string passwd_str = to_string(env, passwd);
+
+    try {
+        zf->login(user_str, passwd_str, environment_str);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_logout0(JNIEnv *env, jclass clazz, jlong ptr) {
+    TRACE_SCOPE("logout0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->logout();
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_getOption0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring option) {
+
+    TRACE_SCOPE("getOption0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    string option_str = to_string(env, option);
+
+    try {
+        client_state_t *state = client_state(zf);
+        if (state->has_option(option_str)) {
+            return (jint) state->option(option_str);
+        }
+        return (jint) zf->option(option_str);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_setOption0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring option,
+    jint value) {
+
+    TRACE_SCOPE("setOption0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    string option_str = to_string(env, option);
+
+    try {
+        client_state_t *state = client_state(zf);
+        if (state->has_option(option_str)) {
+            state->option(option_str, value);
+            return;
+        }
+        zf->option(option_str, value);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_getEnvironments0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr) {
+
+    TRACE_SCOPE("getEnvironments0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    vector<string> envvec;
+
+    try {
+        envvec = zf->list_environments();
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return NULL;
+    }
+
+    int len = envvec.size();
+
+    jobjectArray stringArray = env->NewObjectArray(len, String, NULL);
+
+    for (int i = 0; i < len; i ++) {
+        env->SetObjectArrayElement(stringArray, (jsize) i, (jobject) env->NewStringUTF(envvec[i].c_str()));
+    }
+
+    return stringArray;
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_getAccounts0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr) {
+
+    TRACE_SCOPE("getAccounts0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    vector<string> actvec;
+
+    try {
+        actvec = zf->list_accounts();
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return NULL;
+    }
+
+    int len = actvec.size();
 
     jobjectArray stringArray = env->NewObjectArray(len, String, NULL);
 
-    for (int i = 0; i < len; i ++) {
-        env->SetObjectArrayElement(stringArray, (jsize) i, (jobject) env->NewStringUTF(envvec[i].c_str()));
+    for (int i = 0; i < len; i ++) {
+        env->SetObjectArrayElement(stringArray, (jsize) i, (jobject) env->NewStringUTF(actvec[i].c_str()));
+    }
+
+    return stringArray;
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_lookupAccount0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring name) {
+
+    TRACE_SCOPE("lookupAccount0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    string name_str = to_string(env, name);
+
+    try {
+        return zf->lookup_account(name_str);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_subscribeAccount0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint flags) {
+
+    TRACE_SCOPE("subscribeAccount0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->subscribe_account(acctno, flags);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_unsubscribeAccount0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno) {
+
+    TRACE_SCOPE("unsubscribeAccount0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->unsubscribe_account(acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayOpenOrders0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno) {
+
+    TRACE_SCOPE("replayOpenOrders0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->request_open_orders(acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayOrders0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint from,
+    jint to) {
+
+    TRACE_SCOPE("replayOrders0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->request_orders(from, to, acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayProfitLoss0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno) {
+
+    TRACE_SCOPE("replayProfitLoss0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->request_pl(acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayPositions0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno) {
+
+    TRACE_SCOPE("replayPositions0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->request_positions(acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_cancelAll0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno) {
+
+    TRACE_SCOPE("cancelAll0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zf->cancel_all(acctno);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+order_filter_t orderFilter(
+    JNIEnv *env,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint side,
+    jstring tag,
+    jstring zentag) {
+
+    order_filter_t filter;
+    filter.acct = to_string(env, acctName);
+    filter.symbol = to_string(env, symbol);
+    filter.exchange = to_string(env, exchange);
+    filter.side = (int) side;
+    filter.tag = to_string(env, tag);
+    filter.zentag = to_string(env, zentag);
+    return filter;
+}
+
+/**
+ * Runs an action over the selected orders, carrying on past failures so one
+ * bad order does not leave the rest standing. Returns how many succeeded;
+ * each order that failed is reported as an ALERT_ACTION_FAILED alert rather
+ * than thrown, so the count always reaches the caller.
+ */
+template <typename action_t>
+jint massAction(zenfire::client_t *zf, const order_filter_t &filter, action_t action) {
+    client_state_t *state = client_state(zf);
+    vector<zenfire::order_ptr> orders;
+    state->select_orders(filter, orders);
+
+    jint done = 0;
+    for (size_t i = 0; i < orders.size(); i ++) {
+        try {
+            action(state, orders[i]);
+            done ++;
+        } catch (exception &ex) {
+            action_failed(state, orders[i], ex.what());
+        }
+    }
+    return done;
+}
+
+class cancel_action_t {
+    private:
+    string reason;
+
+    public:
+    cancel_action_t(const string &reason) : reason(reason) { }
+
+    void operator()(client_state_t *state, const zenfire::order_ptr &order) const {
+        throttle.submit(state, order, THROTTLE_CANCEL, reason);
+    }
+};
+
+/**
+ * Moves the limit price by a number of ticks, through the modify coalescer.
+ * The shift applies to the price a pending modify will set, so repeated
+ * calls add up before the first is acknowledged.
+ */
+class reprice_action_t {
+    private:
+    jlong ticks;
+
+    public:
+    reprice_action_t(jlong ticks) : ticks(ticks) { }
+
+    void operator()(client_state_t *state, const zenfire::order_ptr &order) const {
+        const zenfire::product::product_t &prod = order->product();
+        double price = from_ticks(to_ticks(state->coalescer.target_price(order), prod) + ticks, prod);
+        state->coalescer.modify(order, MODIFY_PRICE, price, 0, 0.0);
+    }
+};
+
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_massCancel0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint side,
+    jstring tag,
+    jstring zentag,
+    jstring reason) {
+
+    TRACE_SCOPE("massCancel0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        return massAction(zf, orderFilter(env, acctName, symbol, exchange, side, tag, zentag),
+            cancel_action_t(to_string(env, reason)));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_massRepriceTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint side,
+    jstring tag,
+    jstring zentag,
+    jlong ticks) {
+
+    TRACE_SCOPE("massRepriceTicks0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        order_filter_t filter = orderFilter(env, acctName, symbol, exchange, side, tag, zentag);
+        filter.limit_only = true;
+        return massAction(zf, filter, reprice_action_t(ticks));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0;
+    }
+}
+
+enum snapshot_kind_t {
+    SNAPSHOT_OPEN_ORDERS,
+    SNAPSHOT_ORDERS,
+    SNAPSHOT_PROFIT_LOSS,
+    SNAPSHOT_POSITIONS
+};
+
+/**
+ * Issues one of the account replay requests and gathers the reports it
+ * produces. Returns {int[] type, int[] qty, double[] price, long[] order,
+ * long[] ts (usec)}; order handles (0 for reports without an order) are
+ * owned by the caller, and their messages are kept for reportGetMessage0.
+ */
+jobjectArray snapshot(
+    JNIEnv *env,
+    jlong ptr,
+    snapshot_kind_t kind,
+    jint acctno,
+    jint from,
+    jint to,
+    jint timeoutMillis) {
+
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    client_state_t *state;
+    string account;
+    try {
+        state = client_state(zf);
+        vector<string> accounts = zf->list_accounts();
+        for (size_t i = 0; i < accounts.size(); i ++) {
+            if (zf->lookup_account(accounts[i]) == acctno) {
+                account = accounts[i];
+                break;
+            }
+        }
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return NULL;
+    }
+    if (account.empty()) {
+        env->ThrowNew(InvalidAccountException, "no such account");
+        return NULL;
+    }
+
+    report_capture_t capture(account, state);
+    {
+        scoped_lock l(state->lock);
+        if (state->report_capture != NULL) {
+            env->ThrowNew(InvalidException, "a snapshot is already running");
+            return NULL;
+        }
+        state->report_capture = &capture;
+    }
+
+    try {
+        switch (kind) {
+            case SNAPSHOT_OPEN_ORDERS: zf->request_open_orders(acctno); break;
+            case SNAPSHOT_ORDERS: zf->request_orders(from, to, acctno); break;
+            case SNAPSHOT_PROFIT_LOSS: zf->request_pl(acctno); break;
+            case SNAPSHOT_POSITIONS: zf->request_positions(acctno); break;
+        }
+    } catch (exception &ex) {
+        scoped_lock l(state->lock);
+        state->report_capture = NULL;
+        throw_java(env, &ex);
+        return NULL;
+    }
+
+    {
+        scoped_lock l(state->lock);
+        capture.wait(state->lock, state->snapshot_quiet_ms, timeoutMillis);
+        state->report_capture = NULL;
+    }
+
+    jsize n = (jsize) capture.type.size();
+    jobjectArray columns = env->NewObjectArray(5, Object, NULL);
+    if (columns == NULL) return NULL;
+
+    jintArray type = env->NewIntArray(n);
+    if (type == NULL) return NULL;
+    jintArray qty = env->NewIntArray(n);
+    if (qty == NULL) return NULL;
+    jdoubleArray price = env->NewDoubleArray(n);
+    if (price == NULL) return NULL;
+    jlongArray order = env->NewLongArray(n);
+    if (order == NULL) return NULL;
+    jlongArray ts = env->NewLongArray(n);
+    if (ts == NULL) return NULL;
+
+    if (n > 0) {
+        env->SetIntArrayRegion(type, 0, n, &capture.type[0]);
+        env->SetIntArrayRegion(qty, 0, n, &capture.qty[0]);
+        env->SetDoubleArrayRegion(price, 0, n, &capture.price[0]);
+        env->SetLongArrayRegion(order, 0, n, &capture.order[0]);
+        env->SetLongArrayRegion(ts, 0, n, &capture.ts[0]);
+    }
+
+    env->SetObjectArrayElement(columns, 0, type);
+    env->SetObjectArrayElement(columns, 1, qty);
+    env->SetObjectArrayElement(columns, 2, price);
+    env->SetObjectArrayElement(columns, 3, order);
+    env->SetObjectArrayElement(columns, 4, ts);
+
+    // the handles are Java's now
+    capture.order.clear();
+
+    return columns;
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_snapshotOpenOrders0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint timeoutMillis) {
+
+    TRACE_SCOPE("snapshotOpenOrders0");
+    return snapshot(env, ptr, SNAPSHOT_OPEN_ORDERS, acctno, 0, 0, timeoutMillis);
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_snapshotOrders0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint from,
+    jint to,
+    jint timeoutMillis) {
+
+    TRACE_SCOPE("snapshotOrders0");
+    return snapshot(env, ptr, SNAPSHOT_ORDERS, acctno, from, to, timeoutMillis);
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_snapshotProfitLoss0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint timeoutMillis) {
+
+    TRACE_SCOPE("snapshotProfitLoss0");
+    return snapshot(env, ptr, SNAPSHOT_PROFIT_LOSS, acctno, 0, 0, timeoutMillis);
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_snapshotPositions0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint acctno,
+    jint timeoutMillis) {
+
+    TRACE_SCOPE("snapshotPositions0");
+    return snapshot(env, ptr, SNAPSHOT_POSITIONS, acctno, 0, 0, timeoutMillis);
+}
+
+/**
+ * Instruments are immutable on the Java side, so one global ref is built per
+ * product and handed out again on later lookups. MathContexts are shared per
+ * precision.
+ */
+mutex_t instruments_lock;
+map<pair<string, int>, jobject> instruments;
+map<int, jobject> math_contexts;
+
+jobject mathContextFor(JNIEnv *env, jint precision) {
+    {
+        scoped_lock l(instruments_lock);
+        map<int, jobject>::iterator it = math_contexts.find(precision);
+        if (it != math_contexts.end()) return it->second;
+    }
+
+    jobject local = env->NewObject(MathContext, MathContext_init, (jint) precision);
+    if (env->ExceptionCheck()) return NULL;
+    jobject mathContext = env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    if (mathContext == NULL) return NULL;
+
+    scoped_lock l(instruments_lock);
+    pair<map<int, jobject>::iterator, bool> ins = math_contexts.insert(make_pair((int) precision, mathContext));
+    if (! ins.second) {
+        // lost a race, keep the first one
+        env->DeleteGlobalRef(mathContext);
+    }
+    return ins.first->second;
+}
+
+jobject buildInstrument(JNIEnv *env, const zenfire::product::product_t &prod) {
+    jint precision = prod.precision;
+    jobject mathContext = mathContextFor(env, precision);
+    if (mathContext == NULL) return NULL;
+
+    jobject spec;
+    if (prod.has_specs) {
+        jobject pointValue = env->NewObject(BigDecimal, BigDecimal_init, prod.point_value, mathContext);
+        if (env->ExceptionCheck()) return NULL;
+        jobject currency = env->NewStringUTF(prod.currency.c_str());
+        if (env->ExceptionCheck()) return NULL;
+        jobject description = env->NewStringUTF(prod.description.c_str());
+        if (env->ExceptionCheck()) return NULL;
+        spec = env->NewObject(Instrument_Specification, Instrument_Specification_init, precision, pointValue, currency, description);
+        if (env->ExceptionCheck()) return NULL;
+    } else {
+        spec = NULL;
+    }
+    jstring symbol = env->NewStringUTF(prod.symbol.c_str());
+    if (env->ExceptionCheck()) return NULL;
+    jstring exchange = env->NewStringUTF(zenfire::exchange::to_string(prod.exchange).c_str());
+    if (env->ExceptionCheck()) return NULL;
+
+    jobject tickSize = env->NewObject(BigDecimal, BigDecimal_init, (jdouble) prod.increment, mathContext);
+    if (env->ExceptionCheck()) return NULL;
+    jobject inst = env->NewObject(Instrument, Instrument_init, symbol, exchange, tickSize, precision, spec);
+    if (env->ExceptionCheck()) return NULL;
+    return inst;
+}
+
+jobject createInstrument(JNIEnv *env, const zenfire::product::product_t &prod) {
+    pair<string, int> key(prod.symbol, (int) prod.exchange);
+    {
+        scoped_lock l(instruments_lock);
+        map<pair<string, int>, jobject>::iterator it = instruments.find(key);
+        if (it != instruments.end()) return env->NewLocalRef(it->second);
+    }
+
+    jobject local = buildInstrument(env, prod);
+    if (local == NULL) return NULL;
+    jobject inst = env->NewGlobalRef(local);
+    if (inst == NULL) return local;
+
+    scoped_lock l(instruments_lock);
+    pair<map<pair<string, int>, jobject>::iterator, bool> ins = instruments.insert(make_pair(key, inst));
+    if (! ins.second) {
+        env->DeleteGlobalRef(inst);
+    }
+    return local;
+}
+
+extern "C" JNIEXPORT jobject JNICALL Java_jzenfire_ClientImpl_lookupInstrument0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring symbol,
+    jstring exchange) {
+
+    TRACE_SCOPE("lookupInstrument0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    string symbol_str = to_string(env, symbol);
+    string exchange_str = to_string(env, exchange);
+
+    zenfire::product::product_t prod;
+
+    try {
+        prod = zf->lookup_product(zenfire::arg::product(symbol_str, exchange_str));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return NULL;
+    }
+
+    return createInstrument(env, prod);
+}
+
+/**
+ * A limit or trigger price as passed to the order natives, either a price or
+ * a tick count to be converted with the order's product.
+ */
+class order_price_t {
+    private:
+    bool in_ticks;
+    double price;
+    jlong ticks;
+
+    public:
+    order_price_t(jdouble price) : in_ticks(false), price(price), ticks(0) { }
+    order_price_t(jlong ticks, bool) : in_ticks(true), price(0.0), ticks(ticks) { }
+
+    double resolve(const zenfire::product::product_t &prod) const {
+        return in_ticks ? from_ticks(ticks, prod) : price;
+    }
+};
+
+/**
+ * Places or prepares an order of the given type: 1 market, 2 limit, 3 stop
+ * market, 4 stop limit. Returns an empty pointer for any other type.
+ */
+zenfire::order_ptr make_order(
+    zenfire::client_t *zf,
+    bool prepare,
+    int type,
+    double limitPrice,
+    double triggerPrice,
+    const zenfire::arg::market &args,
+    int account_number) {
+
+    TRACE_SCOPE("make_order");
+    switch (type) {
+        case 1: {
+            return prepare
+                ? zf->prepare_order(args, account_number)
+                : zf->place_order(args, account_number);
+        }
+        case 2: {
+            zenfire::arg::limit largs(limitPrice, args);
+            return prepare
+                ? zf->prepare_order(largs, account_number)
+                : zf->place_order(largs, account_number);
+        }
+        case 3: {
+            zenfire::arg::stop_market sargs(triggerPrice, args);
+            return prepare
+                ? zf->prepare_order(sargs, account_number)
+                : zf->place_order(sargs, account_number);
+        }
+        case 4: {
+            zenfire::arg::stop_limit slargs(triggerPrice, zenfire::arg::limit(limitPrice, args));
+            return prepare
+                ? zf->prepare_order(slargs, account_number)
+                : zf->place_order(slargs, account_number);
+        }
+    }
+    return zenfire::order_ptr();
+}
+
+jlong submitOrder(
+    JNIEnv *env,
+    jlong ptr,
+    bool prepare,
+    jint type,
+    const order_price_t &limit,
+    const order_price_t &trigger,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jstring zentag,
+    jstring tag) {
+
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    order_handle_t *optr = NULL;
+
+    zenfire::arg::market args = zenfire::arg::market();
+
+    int account_number;
+    try {
+        TRACE_SCOPE("submitOrder.lookup");
+        account_number = zf->lookup_account(to_string(env, acctName));
+        args.product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
+    }
+
+    args.action = (zenfire::order::action_t) action;
+    args.qty = (int) qty;
+    args.duration = (zenfire::order::duration_t) duration;
+    args.zentag = to_string(env, zentag);
+    args.tag = to_string(env, tag);
+
+    try {
+        // while rates are set, an order is prepared here and its send paced
+        bool paced = ! prepare && throttle.limited();
+        // only the prices the order type uses are converted, so a market
+        // order on a product without an increment still goes out
+        double limitPrice = type == ORDER_LIMIT || type == ORDER_STOP_LIMIT ? limit.resolve(args.product) : 0.0;
+        double triggerPrice = type == ORDER_STOP_MARKET || type == ORDER_STOP_LIMIT ? trigger.resolve(args.product) : 0.0;
+        zenfire::order_ptr order = make_order(zf, prepare || paced, type,
+            limitPrice, triggerPrice, args, account_number);
+        if (order) {
+            client_state_t *state = client_state(zf);
+            if (paced) {
+                throttle.submit(state, order, THROTTLE_SEND);
+            }
+            optr = new order_handle_t(order, state);
+        }
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
+    }
+
+    if (! prepare && optr != NULL) {
+        try {
+            client_state(zf)->track_order(optr->order, true);
+        } catch (exception &) {
+            // not one of ours; nothing to track
+        }
+    }
+    return (jlong) optr;
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_placeOrder0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint type,
+    jdouble limitPrice,
+    jdouble triggerPrice,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jobject order,
+    jstring zentag,
+    jstring tag) {
+
+    TRACE_SCOPE("placeOrder0");
+    return submitOrder(env, ptr, false, type, order_price_t(limitPrice), order_price_t(triggerPrice),
+        acctName, symbol, exchange, action, qty, duration, zentag, tag);
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_placeOrderTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint type,
+    jlong limitTicks,
+    jlong triggerTicks,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jobject order,
+    jstring zentag,
+    jstring tag) {
+
+    TRACE_SCOPE("placeOrderTicks0");
+    return submitOrder(env, ptr, false, type, order_price_t(limitTicks, true), order_price_t(triggerTicks, true),
+        acctName, symbol, exchange, action, qty, duration, zentag, tag);
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_prepareOrder0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint type,
+    jdouble limitPrice,
+    jdouble triggerPrice,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jobject order,
+    jstring zentag,
+    jstring tag) {
+
+    TRACE_SCOPE("prepareOrder0");
+    return submitOrder(env, ptr, true, type, order_price_t(limitPrice), order_price_t(triggerPrice),
+        acctName, symbol, exchange, action, qty, duration, zentag, tag);
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_prepareOrderTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint type,
+    jlong limitTicks,
+    jlong triggerTicks,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jobject order,
+    jstring zentag,
+    jstring tag) {
+
+    TRACE_SCOPE("prepareOrderTicks0");
+    return submitOrder(env, ptr, true, type, order_price_t(limitTicks, true), order_price_t(triggerTicks, true),
+        acctName, symbol, exchange, action, qty, duration, zentag, tag);
+}
+
+/**
+ * Pools of prepared orders built from fixed templates, so that sending one
+ * costs only setting its price and qty. Account and product lookups happen
+ * once, when a pool is created; a refill thread, placed as a sender thread,
+ * prepares orders in the background to keep every pool at its depth,
+ * taking the pools in turn. A pool whose orders fail to build is left alone
+ * for a back-off period while the others are served. An empty pool builds
+ * the order inline and counts a miss.
+ */
+class order_pools_t {
+    private:
+    struct pool_t {
+        int type;
+        double limit;
+        double trigger;
+        zenfire::arg::market args;
+        int account;
+        size_t depth;
+        deque<order_handle_t *> ready;
+
+        jlong taken;
+        jlong misses;
+        jlong refills;
+        jlong failures;
+        jlong refill_ns;
+        jlong refill_max_ns;
+        // monotonic time before which a failing pool is not refilled
+        jlong retry_at;
+
+        pool_t() : taken(0), misses(0), refills(0), failures(0), refill_ns(0), refill_max_ns(0), retry_at(0) { }
+
+        ~pool_t() {
+            for (size_t i = 0; i < ready.size(); i ++) {
+                delete ready[i];
+            }
+        }
+    };
+
+    zenfire::client_t *zf;
+    mutex_t lock;
+    map<int, pool_t *> pools;
+    int next_id;
+    // pool refilled last; the next pass starts after it
+    int last_id;
+    signal_t refill;
+    volatile int stopping;
+    bool started;
+    pthread_t thread;
+
+    order_pools_t(const order_pools_t &);
+    order_pools_t& operator=(const order_pools_t &);
+
+    static void *run(void *self) {
+        ((order_pools_t *) self)->refill_loop();
+        return NULL;
+    }
+
+    void refill_loop() {
+        while (! stopping) {
+            sender_threads.enter();
+
+            uint32_t seen = refill.current();
+            int id = -1;
+            jlong wait = -1;
+            pool_t tmpl;
+            {
+                scoped_lock l(lock);
+                jlong now = monotonic_ns();
+                map<int, pool_t *>::iterator it = pools.upper_bound(last_id);
+                for (size_t n = 0; n < pools.size(); n ++, ++ it) {
+                    if (it == pools.end()) {
+                        it = pools.begin();
+                    }
+                    pool_t *pool = it->second;
+                    if (pool->ready.size() >= pool->depth) {
+                        continue;
+                    }
+                    if (pool->retry_at > now) {
+                        if (wait < 0 || pool->retry_at - now < wait) {
+                            wait = pool->retry_at - now;
+                        }
+                        continue;
+                    }
+                    id = it->first;
+                    tmpl.type = pool->type;
+                    tmpl.limit = pool->limit;
+                    tmpl.trigger = pool->trigger;
+                    tmpl.args = pool->args;
+                    tmpl.account = pool->account;
+                    break;
+                }
+            }
+            if (id < 0) {
+                refill.wait(seen, wait < 0 ? 0 : (long) (wait / 1000000) + 1);
+                continue;
+            }
+            last_id = id;
+
+            jlong start = monotonic_ns();
+            zenfire::order_ptr order;
+            try {
+                order = make_order(zf, true, tmpl.type, tmpl.limit, tmpl.trigger, tmpl.args, tmpl.account);
+            } catch (exception &) {
+                order.reset();
+            }
+            jlong ns = monotonic_ns() - start;
+
+            {
+                scoped_lock l(lock);
+                map<int, pool_t *>::iterator it = pools.find(id);
+                if (it != pools.end()) {
+                    pool_t *pool = it->second;
+                    if (order) {
+                        pool->ready.push_back(new order_handle_t(order, NULL));
+                        pool->refills ++;
+                        pool->refill_ns += ns;
+                        if (ns > pool->refill_max_ns) {
+                            pool->refill_max_ns = ns;
+                        }
+                    } else {
+                        // back off rather than spin on an order that cannot be built
+                        pool->failures ++;
+                        pool->retry_at = monotonic_ns() + 100000000L;
+                    }
+                }
+            }
+        }
+    }
+
+    pool_t *find(int id) {
+        map<int, pool_t *>::iterator it = pools.find(id);
+        if (it == pools.end()) {
+            throw std::invalid_argument("Unknown order pool");
+        }
+        return it->second;
+    }
+
+    public:
+    order_pools_t(zenfire::client_t *zf) : zf(zf), next_id(1), last_id(0), stopping(0), started(false) { }
+
+    ~order_pools_t() {
+        if (started) {
+            stopping = 1;
+            refill.notify();
+            pthread_join(thread, NULL);
+        }
+        for (map<int, pool_t *>::iterator it = pools.begin(); it != pools.end(); ++ it) {
+            delete it->second;
+        }
+    }
+
+    int create(int type, double limit, double trigger, const zenfire::arg::market &args,
+        int account, size_t depth) {
+
+        if (type < 1 || type > 4) {
+            throw std::invalid_argument("Unknown order type");
+        }
+        pool_t *pool = new pool_t();
+        pool->type = type;
+        pool->limit = limit;
+        pool->trigger = trigger;
+        pool->args = args;
+        pool->account = account;
+        pool->depth = depth;
+
+        int id;
+        {
+            scoped_lock l(lock);
+            if (! started) {
+                if (pthread_create(&thread, NULL, run, this) != 0) {
+                    delete pool;
+                    throw std::runtime_error("Failed to start order pool thread");
+                }
+                started = true;
+            }
+            id = next_id ++;
+            pools[id] = pool;
+        }
+        refill.notify();
+        return id;
+    }
+
+    void destroy(int id) {
+        pool_t *pool;
+        {
+            scoped_lock l(lock);
+            pool = find(id);
+            pools.erase(id);
+        }
+        delete pool;
+    }
+
+    /** Takes a prepared order handle, building one if the pool is empty. */
+    order_handle_t *take(int id, int &type) {
+        pool_t tmpl;
+        {
+            scoped_lock l(lock);
+            pool_t *pool = find(id);
+            type = pool->type;
+            if (! pool->ready.empty()) {
+                order_handle_t *order = pool->ready.front();
+                pool->ready.pop_front();
+                pool->taken ++;
+                refill.notify();
+                return order;
+            }
+            pool->misses ++;
+            tmpl.args = pool->args;
+            tmpl.limit = pool->limit;
+            tmpl.trigger = pool->trigger;
+            tmpl.account = pool->account;
+        }
+        refill.notify();
+        return new order_handle_t(make_order(zf, true, type, tmpl.limit, tmpl.trigger, tmpl.args, tmpl.account), NULL);
+    }
+
+    /**
+     * {ready, depth, taken, misses, refills, refill failures,
+     *  mean refill ns, max refill ns}
+     */
+    void stats(int id, jlong out[8]) {
+        scoped_lock l(lock);
+        pool_t *pool = find(id);
+        out[0] = pool->ready.size();
+        out[1] = pool->depth;
+        out[2] = pool->taken;
+        out[3] = pool->misses;
+        out[4] = pool->refills;
+        out[5] = pool->failures;
+        out[6] = pool->refills > 0 ? pool->refill_ns / pool->refills : 0;
+        out[7] = pool->refill_max_ns;
+    }
+};
+
+void free_order_pools(client_state_t *state) {
+    order_pools_t *pools;
+    {
+        scoped_lock l(state->lock);
+        pools = state->pools;
+        state->pools = NULL;
+    }
+    delete pools;
+}
+
+order_pools_t &order_pools(client_state_t *state, zenfire::client_t *zf) {
+    scoped_lock l(state->lock);
+    if (state->pools == NULL) {
+        state->pools = new order_pools_t(zf);
+    }
+    return *state->pools;
+}
+
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_poolCreate0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint type,
+    jdouble limitPrice,
+    jdouble triggerPrice,
+    jstring acctName,
+    jstring symbol,
+    jstring exchange,
+    jint action,
+    jint qty,
+    jint duration,
+    jstring zentag,
+    jstring tag,
+    jint depth) {
+
+    TRACE_SCOPE("poolCreate0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    zenfire::arg::market args = zenfire::arg::market();
+
+    try {
+        int account_number = zf->lookup_account(to_string(env, acctName));
+        args.product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
+        args.action = (zenfire::order::action_t) action;
+        args.qty = (int) qty;
+        args.duration = (zenfire::order::duration_t) duration;
+        args.zentag = to_string(env, zentag);
+        args.tag = to_string(env, tag);
+
+        if (depth <= 0) {
+            throw std::invalid_argument("Order pool depth must be positive");
+        }
+        return order_pools(client_state(zf), zf).create((int) type, (double) limitPrice, (double) triggerPrice,
+            args, account_number, (size_t) depth);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_poolDestroy0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint pool) {
+
+    TRACE_SCOPE("poolDestroy0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        order_pools(client_state(zf), zf).destroy((int) pool);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+/**
+ * Takes an order from the pool, sets its prices and qty (qty <= 0 keeps the
+ * template's) and sends it. Returns the order handle, as placeOrder0 does.
+ */
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_poolSend0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint pool,
+    jdouble limitPrice,
+    jdouble triggerPrice,
+    jint qty) {
+
+    TRACE_SCOPE("poolSend0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    order_handle_t *optr = NULL;
+
+    try {
+        // resolved once; every lookup takes the process-wide client lock
+        client_state_t *state = client_state(zf);
+        int type;
+        optr = order_pools(state, zf).take((int) pool, type);
+        zenfire::order_ptr &order = optr->order;
+        if (type == 2 || type == 4) {
+            order->set_price((double) limitPrice);
+        }
+        if (type == 3 || type == 4) {
+            order->set_trigger((double) triggerPrice);
+        }
+        if (qty > 0) {
+            order->set_qty((int) qty);
+        }
+        optr->owner = state;
+        throttle.submit(state, order, THROTTLE_SEND);
+        state->track_order(order, true);
+    } catch (exception &ex) {
+        delete optr;
+        throw_java(env, &ex);
+        return 0L;
+    }
+    return (jlong) optr;
+}
+
+extern "C" JNIEXPORT jlongArray JNICALL Java_jzenfire_ClientImpl_poolStats0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jint pool) {
+
+    TRACE_SCOPE("poolStats0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    jlong stats[8];
+    try {
+        order_pools(client_state(zf), zf).stats((int) pool, stats);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return NULL;
+    }
+
+    jlongArray out = env->NewLongArray(8);
+    if (out != NULL) {
+        env->SetLongArrayRegion(out, 0, 8, stats);
+    }
+    return out;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring symbol,
+    jstring exchange,
+    jint from,
+    jint to) {
+
+    TRACE_SCOPE("replayTicks0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+
+    try {
+        zenfire::product_t product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
+        zf->replay_ticks(product, from, to);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
     }
+}
 
-    return stringArray;
+/** {long[] ts (usec), double[] price, int[] size, byte[] type} */
+jobjectArray tick_columns_to_java(
+    JNIEnv *env,
+    const vector<jlong> &tss,
+    const vector<jdouble> &prices,
+    const vector<jint> &sizes,
+    const vector<jbyte> &types) {
+
+    jsize n = (jsize) tss.size();
+    jobjectArray columns = env->NewObjectArray(4, Object, NULL);
+    if (columns == NULL) return NULL;
+
+    jlongArray ts = env->NewLongArray(n);
+    if (ts == NULL) return NULL;
+    jdoubleArray price = env->NewDoubleArray(n);
+    if (price == NULL) return NULL;
+    jintArray size = env->NewIntArray(n);
+    if (size == NULL) return NULL;
+    jbyteArray type = env->NewByteArray(n);
+    if (type == NULL) return NULL;
+
+    if (n > 0) {
+        env->SetLongArrayRegion(ts, 0, n, &tss[0]);
+        env->SetDoubleArrayRegion(price, 0, n, &prices[0]);
+        env->SetIntArrayRegion(size, 0, n, &sizes[0]);
+        env->SetByteArrayRegion(type, 0, n, &types[0]);
+    }
+
+    env->SetObjectArrayElement(columns, 0, ts);
+    env->SetObjectArrayElement(columns, 1, price);
+    env->SetObjectArrayElement(columns, 2, size);
+    env->SetObjectArrayElement(columns, 3, type);
+
+    return columns;
 }
 
-extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_getAccounts0(
+/**
+ * Replays ticks and collects them natively instead of delivering them to
+ * the tick callback. Returns {long[] ts (usec), double[] price, int[] size,
+ * byte[] type} once the replay has gone quiet for jzenfire.replay_quiet_ms,
+ * or after timeoutMillis.
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_replayTicksBulk0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr) {
+    jlong ptr,
+    jstring symbol,
+    jstring exchange,
+    jint from,
+    jint to,
+    jint timeoutMillis) {
 
+    TRACE_SCOPE("replayTicksBulk0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
-    vector<string> actvec;
-
+    client_state_t *state;
+    zenfire::product_t product;
     try {
-        actvec = zf->list_accounts();
+        state = client_state(zf);
+        product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
     } catch (exception &ex) {
         throw_java(env, &ex);
         return NULL;
     }
 
-    int len = actvec.size();
+    tick_capture_t capture(product, from, to);
+    {
+        scoped_lock l(state->lock);
+        if (state->tick_capture != NULL) {
+            env->ThrowNew(InvalidException, "a bulk tick replay is already running");
+            return NULL;
+        }
+        state->tick_capture = &capture;
+    }
 
-    jobjectArray stringArray = env->NewObjectArray(len, String, NULL);
+    try {
+        zf->replay_ticks(product, from, to);
+    } catch (exception &ex) {
+        scoped_lock l(state->lock);
+        state->tick_capture = NULL;
+        throw_java(env, &ex);
+        return NULL;
+    }
 
-    for (int i = 0; i < len; i ++) {
-        env->SetObjectArrayElement(stringArray, (jsize) i, (jobject) env->NewStringUTF(actvec[i].c_str()));
+    {
+        scoped_lock l(state->lock);
+        capture.wait(state->lock, state->replay_quiet_ms, timeoutMillis);
+        state->tick_capture = NULL;
     }
 
-    return stringArray;
+    return tick_columns_to_java(env, capture.ts, capture.price, capture.size, capture.type);
 }
 
-extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_lookupAccount0(
-    JNIEnv *env,
-    jclass clazz,
-    jlong ptr,
-    jstring name) {
+enum analytics_metric_t {
+    METRIC_VWAP,
+    METRIC_REALIZED_VOL,
+    METRIC_IMBALANCE,
+    METRIC_OHLC
+};
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+jobjectArray series_to_java(JNIEnv *env, interval_series &series, int columns) {
+    jsize n = (jsize) series.start.size();
+    vector<double> *values[] = { &series.a, &series.b, &series.c, &series.d };
+
+    jobjectArray result = env->NewObjectArray(columns + 1, Object, NULL);
+    if (result == NULL) return NULL;
+    jlongArray start = env->NewLongArray(n);
+    if (start == NULL) return NULL;
+    if (n > 0) env->SetLongArrayRegion(start, 0, n, (const jlong *) &series.start[0]);
+    env->SetObjectArrayElement(result, 0, start);
+
+    for (int c = 0; c < columns; c ++) {
+        jdoubleArray column = env->NewDoubleArray(n);
+        if (column == NULL) return NULL;
+        if (n > 0) env->SetDoubleArrayRegion(column, 0, n, &(*values[c])[0]);
+        env->SetObjectArrayElement(result, c + 1, column);
+    }
+    return result;
+}
 
-    string name_str = to_string(env, name);
+/**
+ * Runs one interval metric over tick columns as returned by
+ * replayTicksBulk0, which must be in time order; InvalidException if they
+ * are not. With tradeType >= 0 only ticks of that type are used.
+ * Returns {long[] start, double[] ...} with the metric's value columns.
+ */
+jobjectArray analytics(
+    JNIEnv *env,
+    analytics_metric_t metric,
+    jlongArray ts,
+    jdoubleArray price,
+    jintArray size,
+    jbyteArray type,
+    jint tradeType,
+    jlong intervalMicros) {
+
+    jsize n = env->GetArrayLength(ts);
+    if (env->GetArrayLength(price) != n || env->GetArrayLength(size) != n
+        || (tradeType >= 0 && (type == NULL || env->GetArrayLength(type) != n))) {
+        env->ThrowNew(InvalidException, "tick columns differ in length");
+        return NULL;
+    }
+    if (intervalMicros <= 0) {
+        env->ThrowNew(InvalidException, "interval must be positive");
+        return NULL;
+    }
 
+    interval_series series;
     try {
-        return zf->lookup_account(name_str);
+        // copied out rather than pinned, so the GC is not held off while the
+        // intervals are computed
+        vector<jlong> col_ts(n);
+        vector<jdouble> col_price(n);
+        vector<jint> col_size(n);
+        vector<jbyte> col_type(tradeType >= 0 ? n : 0);
+        if (n > 0) {
+            env->GetLongArrayRegion(ts, 0, n, &col_ts[0]);
+            env->GetDoubleArrayRegion(price, 0, n, &col_price[0]);
+            env->GetIntArrayRegion(size, 0, n, &col_size[0]);
+            if (tradeType >= 0) {
+                env->GetByteArrayRegion(type, 0, n, &col_type[0]);
+            }
+        }
+        if (env->ExceptionCheck()) return NULL;
+
+        tick_columns ticks;
+        ticks.n = n;
+        ticks.ts = n > 0 ? (const int64_t *) &col_ts[0] : NULL;
+        ticks.price = n > 0 ? (const double *) &col_price[0] : NULL;
+        ticks.size = n > 0 ? (const int32_t *) &col_size[0] : NULL;
+
+        vector<int64_t> sel_ts;
+        vector<double> sel_price;
+        vector<int32_t> sel_size;
+        tick_columns used = tradeType >= 0 && n > 0
+            ? select_type(ticks, (const int8_t *) &col_type[0], tradeType, sel_ts, sel_price, sel_size)
+            : ticks;
+        switch (metric) {
+            case METRIC_VWAP: interval_vwap(used, intervalMicros, series); break;
+            case METRIC_REALIZED_VOL: interval_realized_vol(used, intervalMicros, series); break;
+            case METRIC_IMBALANCE: interval_imbalance(used, intervalMicros, series); break;
+            case METRIC_OHLC: interval_ohlc(used, intervalMicros, series); break;
+        }
     } catch (exception &ex) {
         throw_java(env, &ex);
-        return 0;
+        return NULL;
+    }
+
+    switch (metric) {
+        case METRIC_VWAP: return series_to_java(env, series, 2);
+        case METRIC_OHLC: return series_to_java(env, series, 4);
+        default: return series_to_java(env, series, 1);
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_subscribeAccount0(
+/** {start, vwap, volume} */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_analyticsVwap0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint acctno,
-    jint flags) {
+    jlongArray ts,
+    jdoubleArray price,
+    jintArray size,
+    jbyteArray type,
+    jint tradeType,
+    jlong intervalMicros) {
+
+    TRACE_SCOPE("analyticsVwap0");
+    return analytics(env, METRIC_VWAP, ts, price, size, type, tradeType, intervalMicros);
+}
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+/** {start, realized volatility} */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_analyticsRealizedVol0(
+    JNIEnv *env,
+    jclass clazz,
+    jlongArray ts,
+    jdoubleArray price,
+    jintArray size,
+    jbyteArray type,
+    jint tradeType,
+    jlong intervalMicros) {
+
+    TRACE_SCOPE("analyticsRealizedVol0");
+    return analytics(env, METRIC_REALIZED_VOL, ts, price, size, type, tradeType, intervalMicros);
+}
 
-    try {
-        zf->subscribe_account(acctno, flags);
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-    }
+/** {start, imbalance} */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_analyticsImbalance0(
+    JNIEnv *env,
+    jclass clazz,
+    jlongArray ts,
+    jdoubleArray price,
+    jintArray size,
+    jbyteArray type,
+    jint tradeType,
+    jlong intervalMicros) {
+
+    TRACE_SCOPE("analyticsImbalance0");
+    return analytics(env, METRIC_IMBALANCE, ts, price, size, type, tradeType, intervalMicros);
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_unsubscribeAccount0(
+/** {start, open, high, low, close} */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_analyticsOhlc0(
+    JNIEnv *env,
+    jclass clazz,
+    jlongArray ts,
+    jdoubleArray price,
+    jintArray size,
+    jbyteArray type,
+    jint tradeType,
+    jlong intervalMicros) {
+
+    TRACE_SCOPE("analyticsOhlc0");
+    return analytics(env, METRIC_OHLC, ts, price, size, type, tradeType, intervalMicros);
+}
+
+extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_analyticsIsa0(
+    JNIEnv *env,
+    jclass clazz) {
+
+    TRACE_SCOPE("analyticsIsa0");
+    return env->NewStringUTF(analytics_isa());
+}
+
+/**
+ * Starts writing every tick the client receives to a new archive file,
+ * closing any archive it was already writing.
+ */
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_archiveOpen0(
     JNIEnv *env,
     jclass clazz,
     jlong ptr,
-    jint acctno) {
+    jstring path) {
 
+    TRACE_SCOPE("archiveOpen0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
-        zf->unsubscribe_account(acctno);
+        client_state_t *state = client_state(zf);
+        tick_archive_writer *old = state->archive_ticks(new tick_archive_writer(to_string(env, path)));
+        if (old != NULL) {
+            old->close();
+        }
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayOpenOrders0(
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_archiveClose0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint acctno) {
+    jlong ptr) {
 
+    TRACE_SCOPE("archiveClose0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
-        zf->request_open_orders(acctno);
+        tick_archive_writer *old = client_state(zf)->archive_ticks(NULL);
+        if (old != NULL) {
+            old->close();
+        }
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayOrders0(
+/**
+ * Reads one instrument's ticks between from and to (seconds, inclusive, as
+ * replayTicks0) from an archive, as {long[] ts (usec), double[] price,
+ * int[] size, byte[] type}, in time order as the analytics natives take
+ * them.
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL Java_jzenfire_ClientImpl_archiveReadTicks0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint acctno,
+    jstring path,
+    jstring symbol,
+    jstring exchange,
     jint from,
     jint to) {
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
-
+    TRACE_SCOPE("archiveReadTicks0");
+    vector<archived_tick> ticks;
     try {
-        zf->request_orders(from, to, acctno);
+        tick_archive_reader reader(to_string(env, path));
+        int id = reader.find(to_string(env, symbol), to_string(env, exchange));
+        if (id >= 0) {
+            reader.read(id, ((int64_t) from) * 1000000, ((int64_t) to + 1) * 1000000, ticks);
+        }
     } catch (exception &ex) {
         throw_java(env, &ex);
+        return NULL;
+    }
+
+    vector<jlong> ts(ticks.size());
+    vector<jdouble> price(ticks.size());
+    vector<jint> size(ticks.size());
+    vector<jbyte> type(ticks.size());
+    for (size_t i = 0; i < ticks.size(); i ++) {
+        ts[i] = ticks[i].ts;
+        price[i] = ticks[i].price;
+        size[i] = ticks[i].size;
+        type[i] = ticks[i].type;
     }
+
+    return tick_columns_to_java(env, ts, price, size, type);
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayProfitLoss0(
+/**
+ * Hands merged archive ticks to a ClientImpl's tick callback, as if they had
+ * arrived live. Symbol and exchange strings are made once per stream.
+ */
+class java_merge_sink : public merge_sink {
+    private:
+    JNIEnv *env;
+    jobject obj;
+    vector<jobject> symbols;
+    vector<jobject> exchanges;
+
+    public:
+    java_merge_sink(JNIEnv *env, jobject obj) : env(env), obj(obj) { }
+
+    ~java_merge_sink() {
+        for (size_t i = 0; i < symbols.size(); i ++) {
+            env->DeleteGlobalRef(symbols[i]);
+            env->DeleteGlobalRef(exchanges[i]);
+        }
+    }
+
+    void stream(int id, const archive_instrument &inst) {
+        jstring symbol = env->NewStringUTF(inst.symbol.c_str());
+        jstring exchange = env->NewStringUTF(inst.exchange.c_str());
+        symbols.push_back(env->NewGlobalRef(symbol));
+        exchanges.push_back(env->NewGlobalRef(exchange));
+        env->DeleteLocalRef(symbol);
+        env->DeleteLocalRef(exchange);
+    }
+
+    bool tick(int stream, const archived_tick &tick) {
+        env->CallVoidMethod(obj,
+            invokeCallback_tick,
+            (jint) tick.type,
+            (jint) 0,
+            symbols[stream],
+            exchanges[stream],
+            (jlong) (tick.ts / 1000), // millis
+            (jint) (tick.ts % 1000) * 1000, // nanos
+            (jdouble) tick.price,
+            (jint) tick.size);
+        return env->ExceptionCheck() == JNI_FALSE;
+    }
+};
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_mergeReplay0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint acctno) {
+    jobject clientImpl,
+    jobjectArray paths,
+    jint from,
+    jint to,
+    jint threads) {
+
+    TRACE_SCOPE("mergeReplay0");
+    vector<string> files;
+    jsize n = env->GetArrayLength(paths);
+    for (jsize i = 0; i < n; i ++) {
+        jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+        files.push_back(to_string(env, path));
+        env->DeleteLocalRef(path);
+    }
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
+    try {
+        java_merge_sink sink(env, clientImpl);
+        return merge_replay(files, ((int64_t) from) * 1000000, ((int64_t) to + 1) * 1000000,
+            sink, threads);
+    } catch (exception &ex) {
+        if (! env->ExceptionCheck()) {
+            throw_java(env, &ex);
+        }
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_traceDump0(
+    JNIEnv *env,
+    jclass clazz,
+    jstring path) {
 
     try {
-        zf->request_pl(acctno);
+        return (jlong) trace_dump(to_string(env, path));
     } catch (exception &ex) {
         throw_java(env, &ex);
+        return 0L;
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayPositions0(
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_traceArm0(
+    JNIEnv *env,
+    jclass clazz,
+    jstring path,
+    jlong thresholdMicros) {
+
+    trace_arm(to_string(env, path), ((int64_t) thresholdMicros) * 1000);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_shmPublish0(
     JNIEnv *env,
     jclass clazz,
     jlong ptr,
-    jint acctno) {
+    jstring name,
+    jint capacity) {
 
+    TRACE_SCOPE("shmPublish0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
-        zf->request_positions(acctno);
+        client_state_t *state = client_state(zf);
+        state->publish_ticks(new shm_tick_writer(to_string(env, name), (uint32_t) capacity));
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_cancelAll0(
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_shmUnpublish0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint acctno) {
+    jlong ptr) {
 
+    TRACE_SCOPE("shmUnpublish0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
-        zf->cancel_all(acctno);
+        client_state(zf)->publish_ticks(NULL);
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
 }
 
-jobject createInstrument(JNIEnv *env, const zenfire::product::product_t &prod) {
-    jint precision = prod.precision;
-    jobject mathContext = env->NewObject(MathContext, MathContext_init, (jint) precision);
-    if (env->ExceptionCheck()) return NULL;
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_shmAttach0(
+    JNIEnv *env,
+    jclass clazz,
+    jstring name) {
 
-    jobject spec;
-    if (prod.has_specs) {
-        jobject pointValue = env->NewObject(BigDecimal, BigDecimal_init, prod.point_value, mathContext);
-        if (env->ExceptionCheck()) return NULL;
-        jobject currency = env->NewStringUTF(prod.currency.c_str());
-        if (env->ExceptionCheck()) return NULL;
-        jobject description = env->NewStringUTF(prod.description.c_str());
-        if (env->ExceptionCheck()) return NULL;
-        spec = env->NewObject(Instrument_Specification, Instrument_Specification_init, precision, pointValue, currency, description);
-        if (env->ExceptionCheck()) return NULL;
-    } else {
-        spec = NULL;
+    TRACE_SCOPE("shmAttach0");
+    try {
+        return (jlong) new shm_tick_reader(to_string(env, name));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
     }
-    jstring symbol = env->NewStringUTF(prod.symbol.c_str());
-    if (env->ExceptionCheck()) return NULL;
-    jstring exchange = env->NewStringUTF(zenfire::exchange::to_string(prod.exchange).c_str());
-    if (env->ExceptionCheck()) return NULL;
-
-    jobject tickSize = env->NewObject(BigDecimal, BigDecimal_init, (jdouble) prod.increment, mathContext);
-    if (env->ExceptionCheck()) return NULL;
-    jobject inst = env->NewObject(Instrument, Instrument_init, symbol, exchange, tickSize, precision, spec);
-    if (env->ExceptionCheck()) return NULL;
-    return inst;
 }
 
-extern "C" JNIEXPORT jobject JNICALL Java_jzenfire_ClientImpl_lookupInstrument0(
+/**
+ * Copies up to maxRecords ticks into a direct buffer as 64 byte records
+ * (see shm_tick_record), returns the number copied.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_shmRead0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jstring symbol,
-    jstring exchange) {
+    jlong readerPtr,
+    jobject buffer,
+    jint maxRecords) {
 
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
-
-    string symbol_str = to_string(env, symbol);
-    string exchange_str = to_string(env, exchange);
+    TRACE_SCOPE("shmRead0");
+    shm_tick_reader *reader = (shm_tick_reader *)readerPtr;
 
-    zenfire::product::product_t prod;
-
-    try {
-        prod = zf->lookup_product(zenfire::arg::product(symbol_str, exchange_str));
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return NULL;
+    void *addr = env->GetDirectBufferAddress(buffer);
+    jlong room = env->GetDirectBufferCapacity(buffer) / (jlong) sizeof(shm_tick_record);
+    if (addr == NULL || room < 0) {
+        env->ThrowNew(InvalidException, "buffer is not a direct buffer");
+        return 0;
+    }
+    if (maxRecords > room) {
+        maxRecords = (jint) room;
     }
 
-    return createInstrument(env, prod);
+    return (jint) reader->read((shm_tick_record *) addr, maxRecords);
 }
 
-extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_placeOrder0(
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_shmLost0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jint type,
-    jdouble limitPrice,
-    jdouble triggerPrice,
-    jstring acctName,
-    jstring symbol,
-    jstring exchange,
-    jint action,
-    jint qty,
-    jint duration,
-    jobject order,
-    jstring zentag,
-    jstring tag) {
-
-    zenfire::client_t *zf = (zenfire::client_t *)ptr;
-    // pointer to a shared pointer to an order, heh
-    zenfire::order_ptr *optr;
-
-    zenfire::arg::market args = zenfire::arg::market();
+    jlong readerPtr) {
 
-    int account_number;
-    try {
-        account_number = zf->lookup_account(to_string(env, acctName));
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return NULL;
-    }
+    TRACE_SCOPE("shmLost0");
+    return (jlong) ((shm_tick_reader *)readerPtr)->lost();
+}
 
-    args.product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
-    args.action = (zenfire::order::action_t) action;
-    args.qty = (int) qty;
-    args.duration = (zenfire::order::duration_t) duration;
-    args.zentag = to_string(env, zentag);
-    args.tag = to_string(env, tag);
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_shmDetach0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong readerPtr) {
 
-    try {
-        switch (type) {
-            case 1: {
-                optr = new zenfire::order_ptr(zf->place_order(args, account_number));
-                break;
-            }
-            case 2: {
-                optr = new zenfire::order_ptr(zf->place_order(zenfire::arg::limit(limitPrice, args), account_number));
-                break;
-            }
-            case 3: {
-                optr = new zenfire::order_ptr(zf->place_order(zenfire::arg::stop_market(triggerPrice, args), account_number));
-                break;
-            }
-            case 4: {
-                optr = new zenfire::order_ptr(zf->place_order(zenfire::arg::stop_limit(triggerPrice, zenfire::arg::limit(limitPrice, args)), account_number));
-                break;
-            }
+    TRACE_SCOPE("shmDetach0");
+    delete (shm_tick_reader *)readerPtr;
+}
+
+/**
+ * The largest step that a and b are both whole multiples of, within
+ * rounding: the price step of a sum of legs moving by a and b. 0 if either
+ * is unknown or the steps have no common step coarser than a ten-thousandth
+ * of the larger.
+ */
+double common_step(double a, double b) {
+    if (a <= 0.0 || b <= 0.0) {
+        return 0.0;
+    }
+    double largest = a > b ? a : b;
+    double eps = largest * 1e-9;
+    while (b > eps) {
+        double r = fmod(a, b);
+        if (b - r <= eps) {
+            r = 0.0;
         }
-    } catch (exception &ex) {
-        throw_java(env, &ex);
-        return NULL;
+        a = b;
+        b = r;
     }
-    return (jlong) optr;
+    return a >= largest * 1e-4 ? a : 0.0;
 }
 
-extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_prepareOrder0(
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_syntheticDefine0(
     JNIEnv *env,
     jclass clazz,
     jlong ptr,
-    jint type,
-    jdouble limitPrice,
-    jdouble triggerPrice,
-    jstring acctName,
     jstring symbol,
     jstring exchange,
-    jint action,
-    jint qty,
-    jint duration,
-    jobject order,
-    jstring zentag,
-    jstring tag) {
-
+    jobjectArray legSymbols,
+    jobjectArray legExchanges,
+    jdoubleArray weights,
+    jint bidType,
+    jint askType,
+    jint tradeType,
+    jboolean suppressLegs) {
+
+    TRACE_SCOPE("syntheticDefine0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
-    // pointer to a shared pointer to an order, heh
-    zenfire::order_ptr *optr;
 
-    zenfire::arg::market args = zenfire::arg::market();
+    jsize n = env->GetArrayLength(weights);
+    if (env->GetArrayLength(legSymbols) != n || env->GetArrayLength(legExchanges) != n) {
+        std::invalid_argument ex("Synthetic leg arrays differ in length");
+        throw_java(env, &ex);
+        return;
+    }
+
+    vector<synthetic_leg> legs(n);
+    vector<jdouble> w(n);
+    env->GetDoubleArrayRegion(weights, 0, n, n > 0 ? &w[0] : NULL);
+    for (jsize i = 0; i < n; i ++) {
+        jstring legSymbol = (jstring) env->GetObjectArrayElement(legSymbols, i);
+        jstring legExchange = (jstring) env->GetObjectArrayElement(legExchanges, i);
+        legs[i].symbol = to_string(env, legSymbol);
+        legs[i].exchange = to_string(env, legExchange);
+        legs[i].weight = (double) w[i];
+        env->DeleteLocalRef(legSymbol);
+        env->DeleteLocalRef(legExchange);
+    }
+
+    synthetic_types types;
+    types.bid = (int) bidType;
+    types.ask = (int) askType;
+    types.trade = (int) tradeType;
+
+    // for tick units: the step every implied price is a whole multiple of,
+    // or 0 for prices only when the legs' steps have none
+    double increment = 0.0;
+    bool first = true;
+    for (jsize i = 0; i < n; i ++) {
+        double step;
+        try {
+            zenfire::product_t prod = zf->lookup_product(zenfire::arg::product(legs[i].symbol, legs[i].exchange));
+            step = prod.increment * fabs(legs[i].weight);
+        } catch (exception &) {
+            // unknown leg: its ticks never arrive anyway
+            continue;
+        }
+        increment = first ? (step > 0.0 ? step : 0.0) : common_step(increment, step);
+        first = false;
+    }
 
-    int account_number;
     try {
-        account_number = zf->lookup_account(to_string(env, acctName));
+        client_state(zf)->synthetics.define(to_string(env, symbol), to_string(env, exchange),
+            legs, types, increment, suppressLegs == JNI_TRUE);
     } catch (exception &ex) {
         throw_java(env, &ex);
-        return NULL;
     }
+}
 
-    args.product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
-    args.action = (zenfire::order::action_t) action;
-    args.qty = (int) qty;
-    args.duration = (zenfire::order::duration_t) duration;
-    args.zentag = to_string(env, zentag);
-    args.tag = to_string(env, tag);
+extern "C" JNIEXPORT jboolean JNICALL Java_jzenfire_ClientImpl_syntheticRemove0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong ptr,
+    jstring symbol,
+    jstring exchange) {
+
+    TRACE_SCOPE("syntheticRemove0");
+    zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
-        switch (type) {
-            case 1: {
-                optr = new zenfire::order_ptr(zf->prepare_order(args, account_number));
-                break;
-            }
-            case 2: {
-                optr = new zenfire::order_ptr(zf->prepare_order(zenfire::arg::limit(limitPrice, args), account_number));
-                break;
-            }
-            case 3: {
-                optr = new zenfire::order_ptr(zf->prepare_order(zenfire::arg::stop_market(triggerPrice, args), account_number));
-                break;
-            }
-            case 4: {
-                optr = new zenfire::order_ptr(zf->prepare_order(zenfire::arg::stop_limit(triggerPrice, zenfire::arg::limit(limitPrice, args)), account_number));
-                break;
-            }
-        }
+        return client_state(zf)->synthetics.remove(to_string(env, symbol), to_string(env, exchange))
+            ? JNI_TRUE : JNI_FALSE;
     } catch (exception &ex) {
         throw_java(env, &ex);
-        return NULL;
+        return JNI_FALSE;
     }
-    return (jlong) optr;
 }
 
-extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_replayTicks0(
+/**
+ * Per lane, reports, alerts then ticks: backlog, max backlog, delivered,
+ * mean and max latency ns; then the ticks dropped from a full tick lane.
+ */
+extern "C" JNIEXPORT jlongArray JNICALL Java_jzenfire_ClientImpl_laneStats0(
     JNIEnv *env,
     jclass clazz,
-    jlong ptr,
-    jstring symbol,
-    jstring exchange,
-    jint from,
-    jint to) {
+    jlong ptr) {
 
+    TRACE_SCOPE("laneStats0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
+    jlong stats[16];
     try {
-        zenfire::product_t product = zf->lookup_product(zenfire::arg::product(to_string(env, symbol), to_string(env, exchange)));
-        zf->replay_ticks(product, from, to);
+        client_state(zf)->dispatcher->stats(stats);
     } catch (exception &ex) {
         throw_java(env, &ex);
+        return NULL;
+    }
+
+    jlongArray out = env->NewLongArray(16);
+    if (out != NULL) {
+        env->SetLongArrayRegion(out, 0, 16, stats);
     }
+    return out;
 }
 
 extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_subscribe0(
@@ -791,6 +3522,7 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_subscribe0(
     jstring exchange,
     jint flags) {
 
+    TRACE_SCOPE("subscribe0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
@@ -808,6 +3540,7 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_unsubscribe0(
     jstring symbol,
     jstring exchange) {
 
+    TRACE_SCOPE("unsubscribe0");
     zenfire::client_t *zf = (zenfire::client_t *)ptr;
 
     try {
@@ -818,14 +3551,29 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_unsubscribe0(
     }
 }
 
+/*
+ * Primitive order getters also come as critical natives, which HotSpot calls
+ * without the JNIEnv/jclass arguments or a full thread state transition.
+ * Only JDKs before 18 look for them, and only while critical natives are
+ * enabled (-XX:+CriticalJNINatives, deprecated in JDK 16); JDK 18 and later
+ * ignore them. The JNI entry points share the code, so every JVM gets the
+ * same behaviour. No gain from them has been measured. The order getters
+ * are left out of tracing, critical or not, being single field reads.
+ */
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetStatus0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    return (jint) (*orderpp)->status();
+}
+
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetStatus0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-
-    return (jint) (*orderpp)->status();
+    return JavaCritical_jzenfire_ClientImpl_orderGetStatus0(orderPtr);
 }
 
 extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetMessage0(
@@ -833,28 +3581,51 @@ extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetMessage0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF((*orderpp)->message().c_str());
 }
 
+extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_reportGetMessage0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr) {
+
+    order_handle_t *handle = (order_handle_t *)orderPtr;
+
+    return env->NewStringUTF(handle != NULL ? handle->message.c_str() : "");
+}
+
 extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetAccountName0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF((*orderpp)->acct().c_str());
 }
 
+extern "C" JNIEXPORT jdouble JNICALL JavaCritical_jzenfire_ClientImpl_orderGetAvgFillPrice0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jdouble) (*orderpp)->fill_price();
+}
+
 extern "C" JNIEXPORT jdouble JNICALL Java_jzenfire_ClientImpl_orderGetAvgFillPrice0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jdouble) (*orderpp)->fill_price();
+    return JavaCritical_jzenfire_ClientImpl_orderGetAvgFillPrice0(orderPtr);
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetDuration0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jint) (*orderpp)->duration();
 }
 
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetDuration0(
@@ -862,8 +3633,7 @@ extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetDuration0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jint) (*orderpp)->duration();
+    return JavaCritical_jzenfire_ClientImpl_orderGetDuration0(orderPtr);
 }
 
 extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetExchange0(
@@ -871,7 +3641,7 @@ extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetExchange0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF(zenfire::exchange::to_string((*orderpp)->product().exchange).c_str());
 }
@@ -881,18 +3651,31 @@ extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetSymbol0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF((*orderpp)->product().symbol.c_str());
 }
 
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetType0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jint) (*orderpp)->type();
+}
+
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetType0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jint) (*orderpp)->type();
+    return JavaCritical_jzenfire_ClientImpl_orderGetType0(orderPtr);
+}
+
+extern "C" JNIEXPORT jdouble JNICALL JavaCritical_jzenfire_ClientImpl_orderGetLimitPrice0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jdouble) (*orderpp)->price();
 }
 
 extern "C" JNIEXPORT jdouble JNICALL Java_jzenfire_ClientImpl_orderGetLimitPrice0(
@@ -900,45 +3683,92 @@ extern "C" JNIEXPORT jdouble JNICALL Java_jzenfire_ClientImpl_orderGetLimitPrice
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jdouble) (*orderpp)->price();
+    return JavaCritical_jzenfire_ClientImpl_orderGetLimitPrice0(orderPtr);
 }
 
-extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQty0(
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_orderGetLimitPriceTicks0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    try {
+        return to_ticks((*orderpp)->price(), (*orderpp)->product());
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
+    }
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetQty0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
     return (jint) (*orderpp)->qty();
 }
 
-extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetSide0(
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQty0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    return JavaCritical_jzenfire_ClientImpl_orderGetQty0(orderPtr);
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetSide0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
     return (jint) (*orderpp)->action();
 }
 
+extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetSide0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr) {
+
+    return JavaCritical_jzenfire_ClientImpl_orderGetSide0(orderPtr);
+}
+
 extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetTag0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF((*orderpp)->tag().c_str());
 }
 
+extern "C" JNIEXPORT jdouble JNICALL JavaCritical_jzenfire_ClientImpl_orderGetTriggerPrice0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jdouble) (*orderpp)->trigger();
+}
+
 extern "C" JNIEXPORT jdouble JNICALL Java_jzenfire_ClientImpl_orderGetTriggerPrice0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jdouble) (*orderpp)->trigger();
+    return JavaCritical_jzenfire_ClientImpl_orderGetTriggerPrice0(orderPtr);
+}
+
+extern "C" JNIEXPORT jlong JNICALL Java_jzenfire_ClientImpl_orderGetTriggerPriceTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    try {
+        return to_ticks((*orderpp)->trigger(), (*orderpp)->product());
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+        return 0L;
+    }
 }
 
 extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetZenTag0(
@@ -946,18 +3776,31 @@ extern "C" JNIEXPORT jstring JNICALL Java_jzenfire_ClientImpl_orderGetZenTag0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     return env->NewStringUTF((*orderpp)->zentag().c_str());
 }
 
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetReason0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jint) (*orderpp)->reason();
+}
+
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetReason0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jint) (*orderpp)->reason();
+    return JavaCritical_jzenfire_ClientImpl_orderGetReason0(orderPtr);
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetNumber0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+    return (jint) (*orderpp)->number();
 }
 
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetNumber0(
@@ -965,8 +3808,15 @@ extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetNumber0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    return (jint) (*orderpp)->number();
+    return JavaCritical_jzenfire_ClientImpl_orderGetNumber0(orderPtr);
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetQtyOpen0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    return (jint) (*orderpp)->open();
 }
 
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyOpen0(
@@ -974,9 +3824,15 @@ extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyOpen0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    return JavaCritical_jzenfire_ClientImpl_orderGetQtyOpen0(orderPtr);
+}
 
-    return (jint) (*orderpp)->open();
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetQtyFilled0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    return (jint) (*orderpp)->filled();
 }
 
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyFilled0(
@@ -984,9 +3840,15 @@ extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyFilled0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    return JavaCritical_jzenfire_ClientImpl_orderGetQtyFilled0(orderPtr);
+}
+
+extern "C" JNIEXPORT jint JNICALL JavaCritical_jzenfire_ClientImpl_orderGetQtyCancelled0(
+    jlong orderPtr) {
+
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
-    return (jint) (*orderpp)->filled();
+    return (jint) (*orderpp)->canceled();
 }
 
 extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyCancelled0(
@@ -994,9 +3856,7 @@ extern "C" JNIEXPORT jint JNICALL Java_jzenfire_ClientImpl_orderGetQtyCancelled0
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-
-    return (jint) (*orderpp)->canceled();
+    return JavaCritical_jzenfire_ClientImpl_orderGetQtyCancelled0(orderPtr);
 }
 
 extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetPrice0(
@@ -1005,7 +3865,8 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetPrice0(
     jlong orderPtr,
     jdouble price) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderSetSetPrice0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     try {
         (*orderpp)->set_price((double)price);
@@ -1014,13 +3875,30 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetPrice0(
     }
 }
 
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetPriceTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr,
+    jlong ticks) {
+
+    TRACE_SCOPE("orderSetSetPriceTicks0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    try {
+        (*orderpp)->set_price(from_ticks(ticks, (*orderpp)->product()));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
 extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetQty0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr,
     jint qty) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderSetSetQty0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     try {
         (*orderpp)->set_qty((int)qty);
@@ -1035,7 +3913,8 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetTrigger0(
     jlong orderPtr,
     jdouble trigger) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderSetSetTrigger0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     try {
         (*orderpp)->set_trigger((double)trigger);
@@ -1044,15 +3923,32 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetTrigger0(
     }
 }
 
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSetSetTriggerTicks0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr,
+    jlong ticks) {
+
+    TRACE_SCOPE("orderSetSetTriggerTicks0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
+
+    try {
+        (*orderpp)->set_trigger(from_ticks(ticks, (*orderpp)->product()));
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
 extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderSend0(
     JNIEnv *env,
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderSend0");
+    order_handle_t *handle = (order_handle_t *)orderPtr;
 
     try {
-        (*orderpp)->send();
+        throttle.submit(handle->owner, handle->order, THROTTLE_SEND);
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
@@ -1063,13 +3959,105 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderUpdate0(
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderUpdate0");
+    order_handle_t *handle = (order_handle_t *)orderPtr;
+
+    try {
+        throttle.submit(handle->owner, handle->order, THROTTLE_UPDATE);
+    } catch (exception &ex) {
+        throw_java(env, &ex);
+    }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL Java_jzenfire_ClientImpl_orderModifyCoalesced0(
+    JNIEnv *env,
+    jclass clazz,
+    jlong orderPtr,
+    jint fields,
+    jdouble price,
+    jint qty,
+    jdouble trigger) {
+
+    TRACE_SCOPE("orderModifyCoalesced0");
+    order_handle_t *handle = (order_handle_t *)orderPtr;
 
     try {
-        (*orderpp)->update();
+        if (handle->owner == NULL) {
+            throw std::invalid_argument("Order has not been sent");
+        }
+        client_state_t *state = static_cast<client_state_t *>(handle->owner);
+        return state->coalescer.modify(handle->order, (int) fields, (double) price, (int) qty, (double) trigger)
+            ? JNI_TRUE : JNI_FALSE;
     } catch (exception &ex) {
         throw_java(env, &ex);
+        return JNI_FALSE;
+    }
+}
+
+/**
+ * {modifies sent, modifies coalesced, orders with a modify in flight}, over
+ * all clients.
+ */
+extern "C" JNIEXPORT jlongArray JNICALL Java_jzenfire_ClientImpl_modifyStats0(
+    JNIEnv *env,
+    jclass clazz) {
+
+    TRACE_SCOPE("modifyStats0");
+    jlong stats[3] = { 0, 0, 0 };
+    {
+        scoped_lock l(client_states_lock);
+        for (map<zenfire::client_t *, client_state_t *>::iterator it = client_states.begin(); it != client_states.end(); ++ it) {
+            it->second->coalescer.stats(stats);
+        }
+    }
+
+    jlongArray out = env->NewLongArray(3);
+    if (out != NULL) {
+        env->SetLongArrayRegion(out, 0, 3, stats);
+    }
+    return out;
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_throttleAccountRate0(
+    JNIEnv *env,
+    jclass clazz,
+    jstring acctName,
+    jdouble perSecond,
+    jint burst) {
+
+    TRACE_SCOPE("throttleAccountRate0");
+    throttle.account_rate(to_string(env, acctName), (double) perSecond, (int) burst);
+}
+
+extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_throttleInstrumentRate0(
+    JNIEnv *env,
+    jclass clazz,
+    jstring symbol,
+    jstring exchange,
+    jdouble perSecond,
+    jint burst) {
+
+    TRACE_SCOPE("throttleInstrumentRate0");
+    throttle.instrument_rate(to_string(env, symbol), to_string(env, exchange), (double) perSecond, (int) burst);
+}
+
+extern "C" JNIEXPORT jlongArray JNICALL Java_jzenfire_ClientImpl_throttleStats0(
+    JNIEnv *env,
+    jclass clazz) {
+
+    TRACE_SCOPE("throttleStats0");
+    int64_t counts[7];
+    throttle.stats(counts);
+    jlong stats[7];
+    for (int i = 0; i < 7; i ++) {
+        stats[i] = (jlong) counts[i];
     }
+
+    jlongArray out = env->NewLongArray(7);
+    if (out != NULL) {
+        env->SetLongArrayRegion(out, 0, 7, stats);
+    }
+    return out;
 }
 
 extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderCancel0(
@@ -1078,10 +4066,11 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderCancel0(
     jlong orderPtr,
     jstring reason) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderCancel0");
+    order_handle_t *handle = (order_handle_t *)orderPtr;
 
     try {
-        (*orderpp)->cancel(to_string(env, reason));
+        throttle.submit(handle->owner, handle->order, THROTTLE_CANCEL, to_string(env, reason));
     } catch (exception &ex) {
         throw_java(env, &ex);
     }
@@ -1092,7 +4081,8 @@ extern "C" JNIEXPORT jobject JNICALL Java_jzenfire_ClientImpl_orderGetInstrument
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
+    TRACE_SCOPE("orderGetInstrument0");
+    zenfire::order_ptr *orderpp = &((order_handle_t *)orderPtr)->order;
 
     try {
         zenfire::product::product_t product = (*orderpp)->product();
@@ -1106,8 +4096,128 @@ extern "C" JNIEXPORT void JNICALL Java_jzenfire_ClientImpl_orderFree0(JNIEnv *en
     jclass clazz,
     jlong orderPtr) {
 
-    zenfire::order_ptr *orderpp = (zenfire::order_ptr *)orderPtr;
-    delete orderpp;
+    TRACE_SCOPE("orderFree0");
+    delete (order_handle_t *)orderPtr;
+}
+
+/**
+ * Every ClientImpl native, bound explicitly at load time instead of through
+ * symbol lookup on first call. Entries are registered one at a time so a
+ * ClientImpl that lacks some of them (an older class, or a signature that
+ * differs) keeps the rest; those fall back to the exported symbols.
+ */
+static JNINativeMethod client_natives[] = {
+    { (char *) "init0", (char *) "()V", (void *) Java_jzenfire_ClientImpl_init0 },
+    { (char *) "create0", (char *) "(Ljzenfire/ClientImpl;Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_create0 },
+    { (char *) "free0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_free0 },
+    { (char *) "login0", (char *) "(JLjava/lang/String;[CLjava/lang/String;)V", (void *) Java_jzenfire_ClientImpl_login0 },
+    { (char *) "logout0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_logout0 },
+    { (char *) "getOption0", (char *) "(JLjava/lang/String;)I", (void *) Java_jzenfire_ClientImpl_getOption0 },
+    { (char *) "setOption0", (char *) "(JLjava/lang/String;I)V", (void *) Java_jzenfire_ClientImpl_setOption0 },
+    { (char *) "getEnvironments0", (char *) "(J)[Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_getEnvironments0 },
+    { (char *) "getAccounts0", (char *) "(J)[Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_getAccounts0 },
+    { (char *) "lookupAccount0", (char *) "(JLjava/lang/String;)I", (void *) Java_jzenfire_ClientImpl_lookupAccount0 },
+    { (char *) "subscribeAccount0", (char *) "(JII)V", (void *) Java_jzenfire_ClientImpl_subscribeAccount0 },
+    { (char *) "unsubscribeAccount0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_unsubscribeAccount0 },
+    { (char *) "replayOpenOrders0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_replayOpenOrders0 },
+    { (char *) "replayOrders0", (char *) "(JIII)V", (void *) Java_jzenfire_ClientImpl_replayOrders0 },
+    { (char *) "replayProfitLoss0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_replayProfitLoss0 },
+    { (char *) "replayPositions0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_replayPositions0 },
+    { (char *) "cancelAll0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_cancelAll0 },
+    { (char *) "massCancel0", (char *) "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;ILjava/lang/String;Ljava/lang/String;Ljava/lang/String;)I", (void *) Java_jzenfire_ClientImpl_massCancel0 },
+    { (char *) "massRepriceTicks0", (char *) "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;ILjava/lang/String;Ljava/lang/String;J)I", (void *) Java_jzenfire_ClientImpl_massRepriceTicks0 },
+    { (char *) "snapshotOpenOrders0", (char *) "(JII)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_snapshotOpenOrders0 },
+    { (char *) "snapshotOrders0", (char *) "(JIIII)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_snapshotOrders0 },
+    { (char *) "snapshotProfitLoss0", (char *) "(JII)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_snapshotProfitLoss0 },
+    { (char *) "snapshotPositions0", (char *) "(JII)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_snapshotPositions0 },
+    { (char *) "lookupInstrument0", (char *) "(JLjava/lang/String;Ljava/lang/String;)Ljzenfire/Instrument;", (void *) Java_jzenfire_ClientImpl_lookupInstrument0 },
+    { (char *) "placeOrder0", (char *) "(JIDDLjava/lang/String;Ljava/lang/String;Ljava/lang/String;IIILjzenfire/Order;Ljava/lang/String;Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_placeOrder0 },
+    { (char *) "placeOrderTicks0", (char *) "(JIJJLjava/lang/String;Ljava/lang/String;Ljava/lang/String;IIILjzenfire/Order;Ljava/lang/String;Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_placeOrderTicks0 },
+    { (char *) "prepareOrder0", (char *) "(JIDDLjava/lang/String;Ljava/lang/String;Ljava/lang/String;IIILjzenfire/Order;Ljava/lang/String;Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_prepareOrder0 },
+    { (char *) "prepareOrderTicks0", (char *) "(JIJJLjava/lang/String;Ljava/lang/String;Ljava/lang/String;IIILjzenfire/Order;Ljava/lang/String;Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_prepareOrderTicks0 },
+    { (char *) "poolCreate0", (char *) "(JIDDLjava/lang/String;Ljava/lang/String;Ljava/lang/String;IIILjava/lang/String;Ljava/lang/String;I)I", (void *) Java_jzenfire_ClientImpl_poolCreate0 },
+    { (char *) "poolDestroy0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_poolDestroy0 },
+    { (char *) "poolSend0", (char *) "(JIDDI)J", (void *) Java_jzenfire_ClientImpl_poolSend0 },
+    { (char *) "poolStats0", (char *) "(JI)[J", (void *) Java_jzenfire_ClientImpl_poolStats0 },
+    { (char *) "replayTicks0", (char *) "(JLjava/lang/String;Ljava/lang/String;II)V", (void *) Java_jzenfire_ClientImpl_replayTicks0 },
+    { (char *) "replayTicksBulk0", (char *) "(JLjava/lang/String;Ljava/lang/String;III)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_replayTicksBulk0 },
+    { (char *) "analyticsVwap0", (char *) "([J[D[I[BIJ)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_analyticsVwap0 },
+    { (char *) "analyticsRealizedVol0", (char *) "([J[D[I[BIJ)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_analyticsRealizedVol0 },
+    { (char *) "analyticsImbalance0", (char *) "([J[D[I[BIJ)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_analyticsImbalance0 },
+    { (char *) "analyticsOhlc0", (char *) "([J[D[I[BIJ)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_analyticsOhlc0 },
+    { (char *) "analyticsIsa0", (char *) "()Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_analyticsIsa0 },
+    { (char *) "archiveOpen0", (char *) "(JLjava/lang/String;)V", (void *) Java_jzenfire_ClientImpl_archiveOpen0 },
+    { (char *) "archiveClose0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_archiveClose0 },
+    { (char *) "archiveReadTicks0", (char *) "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;II)[Ljava/lang/Object;", (void *) Java_jzenfire_ClientImpl_archiveReadTicks0 },
+    { (char *) "mergeReplay0", (char *) "(Ljzenfire/ClientImpl;[Ljava/lang/String;III)J", (void *) Java_jzenfire_ClientImpl_mergeReplay0 },
+    { (char *) "traceDump0", (char *) "(Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_traceDump0 },
+    { (char *) "traceArm0", (char *) "(Ljava/lang/String;J)V", (void *) Java_jzenfire_ClientImpl_traceArm0 },
+    { (char *) "shmPublish0", (char *) "(JLjava/lang/String;I)V", (void *) Java_jzenfire_ClientImpl_shmPublish0 },
+    { (char *) "shmUnpublish0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_shmUnpublish0 },
+    { (char *) "shmAttach0", (char *) "(Ljava/lang/String;)J", (void *) Java_jzenfire_ClientImpl_shmAttach0 },
+    { (char *) "shmRead0", (char *) "(JLjava/nio/ByteBuffer;I)I", (void *) Java_jzenfire_ClientImpl_shmRead0 },
+    { (char *) "shmLost0", (char *) "(J)J", (void *) Java_jzenfire_ClientImpl_shmLost0 },
+    { (char *) "shmDetach0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_shmDetach0 },
+    { (char *) "syntheticDefine0", (char *) "(JLjava/lang/String;Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;[DIIIZ)V", (void *) Java_jzenfire_ClientImpl_syntheticDefine0 },
+    { (char *) "syntheticRemove0", (char *) "(JLjava/lang/String;Ljava/lang/String;)Z", (void *) Java_jzenfire_ClientImpl_syntheticRemove0 },
+    { (char *) "laneStats0", (char *) "(J)[J", (void *) Java_jzenfire_ClientImpl_laneStats0 },
+    { (char *) "subscribe0", (char *) "(JLjava/lang/String;Ljava/lang/String;I)V", (void *) Java_jzenfire_ClientImpl_subscribe0 },
+    { (char *) "unsubscribe0", (char *) "(JLjava/lang/String;Ljava/lang/String;)V", (void *) Java_jzenfire_ClientImpl_unsubscribe0 },
+    { (char *) "orderGetStatus0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetStatus0 },
+    { (char *) "orderGetMessage0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetMessage0 },
+    { (char *) "reportGetMessage0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_reportGetMessage0 },
+    { (char *) "orderGetAccountName0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetAccountName0 },
+    { (char *) "orderGetAvgFillPrice0", (char *) "(J)D", (void *) Java_jzenfire_ClientImpl_orderGetAvgFillPrice0 },
+    { (char *) "orderGetDuration0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetDuration0 },
+    { (char *) "orderGetExchange0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetExchange0 },
+    { (char *) "orderGetSymbol0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetSymbol0 },
+    { (char *) "orderGetType0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetType0 },
+    { (char *) "orderGetLimitPrice0", (char *) "(J)D", (void *) Java_jzenfire_ClientImpl_orderGetLimitPrice0 },
+    { (char *) "orderGetLimitPriceTicks0", (char *) "(J)J", (void *) Java_jzenfire_ClientImpl_orderGetLimitPriceTicks0 },
+    { (char *) "orderGetQty0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetQty0 },
+    { (char *) "orderGetSide0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetSide0 },
+    { (char *) "orderGetTag0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetTag0 },
+    { (char *) "orderGetTriggerPrice0", (char *) "(J)D", (void *) Java_jzenfire_ClientImpl_orderGetTriggerPrice0 },
+    { (char *) "orderGetTriggerPriceTicks0", (char *) "(J)J", (void *) Java_jzenfire_ClientImpl_orderGetTriggerPriceTicks0 },
+    { (char *) "orderGetZenTag0", (char *) "(J)Ljava/lang/String;", (void *) Java_jzenfire_ClientImpl_orderGetZenTag0 },
+    { (char *) "orderGetReason0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetReason0 },
+    { (char *) "orderGetNumber0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetNumber0 },
+    { (char *) "orderGetQtyOpen0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetQtyOpen0 },
+    { (char *) "orderGetQtyFilled0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetQtyFilled0 },
+    { (char *) "orderGetQtyCancelled0", (char *) "(J)I", (void *) Java_jzenfire_ClientImpl_orderGetQtyCancelled0 },
+    { (char *) "orderSetSetPrice0", (char *) "(JD)V", (void *) Java_jzenfire_ClientImpl_orderSetSetPrice0 },
+    { (char *) "orderSetSetPriceTicks0", (char *) "(JJ)V", (void *) Java_jzenfire_ClientImpl_orderSetSetPriceTicks0 },
+    { (char *) "orderSetSetQty0", (char *) "(JI)V", (void *) Java_jzenfire_ClientImpl_orderSetSetQty0 },
+    { (char *) "orderSetSetTrigger0", (char *) "(JD)V", (void *) Java_jzenfire_ClientImpl_orderSetSetTrigger0 },
+    { (char *) "orderSetSetTriggerTicks0", (char *) "(JJ)V", (void *) Java_jzenfire_ClientImpl_orderSetSetTriggerTicks0 },
+    { (char *) "orderSend0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_orderSend0 },
+    { (char *) "orderUpdate0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_orderUpdate0 },
+    { (char *) "orderModifyCoalesced0", (char *) "(JIDID)Z", (void *) Java_jzenfire_ClientImpl_orderModifyCoalesced0 },
+    { (char *) "modifyStats0", (char *) "()[J", (void *) Java_jzenfire_ClientImpl_modifyStats0 },
+    { (char *) "throttleAccountRate0", (char *) "(Ljava/lang/String;DI)V", (void *) Java_jzenfire_ClientImpl_throttleAccountRate0 },
+    { (char *) "throttleInstrumentRate0", (char *) "(Ljava/lang/String;Ljava/lang/String;DI)V", (void *) Java_jzenfire_ClientImpl_throttleInstrumentRate0 },
+    { (char *) "throttleStats0", (char *) "()[J", (void *) Java_jzenfire_ClientImpl_throttleStats0 },
+    { (char *) "orderCancel0", (char *) "(JLjava/lang/String;)V", (void *) Java_jzenfire_ClientImpl_orderCancel0 },
+    { (char *) "orderGetInstrument0", (char *) "(J)Ljzenfire/Instrument;", (void *) Java_jzenfire_ClientImpl_orderGetInstrument0 },
+    { (char *) "orderFree0", (char *) "(J)V", (void *) Java_jzenfire_ClientImpl_orderFree0 },
+};
+
+int natives_registered = 0;
+
+void register_natives(JNIEnv *env) {
+    jclass clazz = env->FindClass("jzenfire/ClientImpl");
+    if (clazz == NULL) {
+        env->ExceptionClear();
+        return;
+    }
+    for (size_t i = 0; i < sizeof(client_natives) / sizeof(client_natives[0]); i ++) {
+        if (env->RegisterNatives(clazz, &client_natives[i], 1) == 0) {
+            natives_registered ++;
+        } else {
+            env->ExceptionClear();
+        }
+    }
+    env->DeleteLocalRef(clazz);
 }
 
 //############################################################################//
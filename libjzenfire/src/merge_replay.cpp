@@ -0,0 +1,307 @@
+
+//############################################################################//
+
+/** \file merge_replay.cpp
+ * \brief Time ordered replay of many tick archives at once
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "merge_replay.hpp"
+#include "threads.hpp"
+
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <queue>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+typedef vector<archived_tick> chunk_t;
+
+/**
+ * One instrument of one file. The worker owning it fills chunks, one per
+ * decoded block, up to the prefetch depth; the merging thread drains them.
+ * A stream whose blocks overlap in time, from ticks appended out of order,
+ * is decoded whole into one sorted chunk instead.
+ */
+struct stream_t {
+    int file;
+    int instrument;
+    int worker;
+    archive_instrument inst;
+    size_t next_block;
+    size_t last_block;
+    bool in_order;
+
+    pthread_mutex_t lock;
+    deque<chunk_t *> chunks;
+    bool done;
+    string error;
+    signal_t data;
+
+    stream_t() : file(0), instrument(0), worker(0), next_block(0), last_block(0), in_order(true), done(false) {
+        pthread_mutex_init(&lock, NULL);
+    }
+
+    ~stream_t() {
+        for (size_t i = 0; i < chunks.size(); i ++) {
+            delete chunks[i];
+        }
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+struct merge_t {
+    const vector<string> *paths;
+    int64_t from;
+    int64_t to;
+    size_t prefetch;
+    vector<stream_t *> streams;
+    vector<signal_t *> space; // per worker
+    volatile int stop;
+};
+
+struct worker_arg {
+    merge_t *merge;
+    int worker;
+};
+
+static void *decode_worker(void *p) {
+    worker_arg *arg = (worker_arg *) p;
+    merge_t *m = arg->merge;
+    int me = arg->worker;
+    signal_t &space = *m->space[me];
+
+    map<int, tick_archive_reader *> readers;
+
+    for (;;) {
+        uint32_t seen = space.current();
+        bool progress = false;
+        bool pending = false;
+
+        for (size_t i = 0; i < m->streams.size() && ! m->stop; i ++) {
+            stream_t *st = m->streams[i];
+            if (st->worker != me || st->done) continue;
+
+            pthread_mutex_lock(&st->lock);
+            bool room = st->chunks.size() < m->prefetch;
+            pthread_mutex_unlock(&st->lock);
+            if (! room) {
+                pending = true;
+                continue;
+            }
+
+            chunk_t *chunk = new chunk_t();
+            string error;
+            try {
+                tick_archive_reader *&reader = readers[st->file];
+                if (reader == NULL) {
+                    reader = new tick_archive_reader((*m->paths)[st->file]);
+                }
+                if (! st->in_order) {
+                    reader->read(st->instrument, m->from, m->to, *chunk);
+                    st->next_block = st->last_block;
+                }
+                // skip blocks with nothing in range
+                while (chunk->empty() && st->next_block < st->last_block) {
+                    reader->read_block(st->instrument, st->next_block ++, m->from, m->to, *chunk);
+                }
+            } catch (exception &ex) {
+                error = ex.what();
+            }
+
+            pthread_mutex_lock(&st->lock);
+            if (! chunk->empty()) {
+                st->chunks.push_back(chunk);
+                chunk = NULL;
+            }
+            if (! error.empty() || st->next_block >= st->last_block) {
+                st->error = error;
+                st->done = true;
+            } else {
+                pending = true;
+            }
+            pthread_mutex_unlock(&st->lock);
+            delete chunk;
+
+            st->data.notify();
+            progress = true;
+        }
+
+        if (m->stop || ! pending) {
+            break;
+        }
+        if (! progress) {
+            space.wait(seen, 0);
+        }
+    }
+
+    for (map<int, tick_archive_reader *>::iterator it = readers.begin(); it != readers.end(); ++ it) {
+        delete it->second;
+    }
+    return NULL;
+}
+
+/** Next chunk of a stream, waiting for its worker; NULL at the end. */
+static chunk_t *next_chunk(merge_t &m, stream_t *st) {
+    for (;;) {
+        uint32_t seen = st->data.current();
+        pthread_mutex_lock(&st->lock);
+        if (! st->chunks.empty()) {
+            chunk_t *chunk = st->chunks.front();
+            st->chunks.pop_front();
+            pthread_mutex_unlock(&st->lock);
+            m.space[st->worker]->notify();
+            return chunk;
+        }
+        if (st->done) {
+            string error = st->error;
+            pthread_mutex_unlock(&st->lock);
+            if (! error.empty()) {
+                throw runtime_error(error);
+            }
+            return NULL;
+        }
+        pthread_mutex_unlock(&st->lock);
+        st->data.wait(seen, 0);
+    }
+}
+
+/** (timestamp, stream): the heap's order, and the tie-break. */
+typedef pair<int64_t, int> head_t;
+
+long long merge_replay(const vector<string> &paths, int64_t from, int64_t to,
+    merge_sink &sink, int threads, int prefetch) {
+
+    merge_t m;
+    m.paths = &paths;
+    m.from = from;
+    m.to = to;
+    m.prefetch = prefetch > 0 ? prefetch : 1;
+    m.stop = 0;
+
+    for (size_t f = 0; f < paths.size(); f ++) {
+        tick_archive_reader reader(paths[f]);
+        for (size_t i = 0; i < reader.instruments().size(); i ++) {
+            size_t first, last;
+            reader.block_range((int) i, from, to, first, last);
+            if (first >= last) continue;
+            stream_t *st = new stream_t();
+            st->file = (int) f;
+            st->instrument = (int) i;
+            st->inst = reader.instruments()[i];
+            st->next_block = first;
+            st->last_block = last;
+            st->in_order = reader.in_order((int) i, first, last);
+            m.streams.push_back(st);
+        }
+    }
+
+    int workers = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > (int) m.streams.size()) workers = (int) m.streams.size();
+    if (workers < 1) workers = 1;
+    for (size_t i = 0; i < m.streams.size(); i ++) {
+        m.streams[i]->worker = (int) (i % workers);
+    }
+
+    vector<pthread_t> tids;
+    vector<worker_arg> args(workers);
+    for (int w = 0; w < workers; w ++) {
+        m.space.push_back(new signal_t());
+    }
+    for (int w = 0; w < workers && ! m.streams.empty(); w ++) {
+        args[w].merge = &m;
+        args[w].worker = w;
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, decode_worker, &args[w]) == 0) {
+            tids.push_back(tid);
+        }
+    }
+
+    long long delivered = 0;
+    string error;
+    vector<chunk_t *> current(m.streams.size(), (chunk_t *) NULL);
+    vector<size_t> pos(m.streams.size(), 0);
+
+    if (! m.streams.empty() && tids.size() < (size_t) workers) {
+        error = "Failed to start replay threads";
+    } else {
+        try {
+            priority_queue<head_t, vector<head_t>, greater<head_t> > heap;
+            for (size_t i = 0; i < m.streams.size(); i ++) {
+                sink.stream((int) i, m.streams[i]->inst);
+            }
+            for (size_t i = 0; i < m.streams.size(); i ++) {
+                current[i] = next_chunk(m, m.streams[i]);
+                if (current[i] != NULL) {
+                    heap.push(head_t((*current[i])[0].ts, (int) i));
+                }
+            }
+
+            while (! heap.empty()) {
+                int s = heap.top().second;
+                heap.pop();
+                chunk_t *chunk = current[s];
+                if (! sink.tick(s, (*chunk)[pos[s]])) {
+                    break;
+                }
+                delivered ++;
+                if (++ pos[s] == chunk->size()) {
+                    delete chunk;
+                    current[s] = next_chunk(m, m.streams[s]);
+                    pos[s] = 0;
+                    chunk = current[s];
+                    if (chunk == NULL) continue;
+                }
+                heap.push(head_t((*chunk)[pos[s]].ts, s));
+            }
+        } catch (exception &ex) {
+            error = ex.what();
+        }
+    }
+
+    m.stop = 1;
+    for (int w = 0; w < workers; w ++) {
+        m.space[w]->notify();
+    }
+    for (size_t i = 0; i < tids.size(); i ++) {
+        pthread_join(tids[i], NULL);
+    }
+    for (size_t i = 0; i < m.streams.size(); i ++) {
+        delete current[i];
+        delete m.streams[i];
+    }
+    for (int w = 0; w < workers; w ++) {
+        delete m.space[w];
+    }
+
+    if (! error.empty()) {
+        throw runtime_error(error);
+    }
+    return delivered;
+}
+
+//############################################################################//
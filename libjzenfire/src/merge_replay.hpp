@@ -0,0 +1,71 @@
+
+//############################################################################//
+
+/** \file merge_replay.hpp
+ * \brief Time ordered replay of many tick archives at once
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_MERGE_REPLAY_HPP
+#define JZENFIRE_MERGE_REPLAY_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include "archive.hpp"
+
+#include <string>
+#include <vector>
+
+/** Receives merged ticks on the thread that called merge_replay(). */
+class merge_sink {
+    public:
+    virtual ~merge_sink() { }
+
+    /** Called once per stream before any ticks, in stream order. */
+    virtual void stream(int id, const archive_instrument &inst) = 0;
+
+    /** Returns false to stop the replay. */
+    virtual bool tick(int stream, const archived_tick &tick) = 0;
+};
+
+/**
+ * Replays the ticks in [from, to) (microseconds) of every instrument in
+ * the given archives as one stream in timestamp order.
+ *
+ * Each instrument is a stream, numbered by file order and then by its
+ * order within the file. Worker threads decode streams a block at a time
+ * into bounded prefetch queues, prefetch blocks deep; the calling thread
+ * merges them with a heap. An instrument whose ticks were archived out of
+ * order is decoded and sorted in full before it is merged, which needs
+ * memory for all its ticks in range. Ticks with equal timestamps are delivered in
+ * stream order, and within a stream in file order, so a replay is
+ * reproducible whatever the thread count. threads <= 0 uses one worker per
+ * CPU, capped at the number of streams.
+ *
+ * Returns the number of ticks delivered. Decoding errors are rethrown on
+ * the calling thread.
+ */
+long long merge_replay(const std::vector<std::string> &paths, int64_t from, int64_t to,
+    merge_sink &sink, int threads = 0, int prefetch = 4);
+
+#endif
+
+//############################################################################//
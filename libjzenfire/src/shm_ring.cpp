@@ -0,0 +1,248 @@
+
+//############################################################################//
+
+/** \file shm_ring.cpp
+ * \brief Single writer, multi reader tick broadcast ring in POSIX shared memory
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "shm_ring.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static const uint32_t SHM_RING_MAGIC = 0x5a465452; // "ZFTR"
+static const uint32_t SHM_RING_VERSION = 1;
+
+/**
+ * Ring header, one cache line. head counts published records and, like the
+ * record stamps, wraps at 32 bits so it can be read atomically on 32-bit
+ * builds from a read-only mapping. Record s is complete when its stamp is
+ * 2s+2 and being written while it is 2s+1.
+ */
+struct shm_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;
+    volatile uint32_t head;
+    char pad[44];
+};
+
+static string shm_name(const string &name) {
+    return name.size() > 0 && name[0] == '/' ? name : "/" + name;
+}
+
+static runtime_error shm_error(const string &what, const string &name) {
+    return runtime_error(what + " " + name + ": " + strerror(errno));
+}
+
+shm_tick_writer::shm_tick_writer(const string &name, uint32_t capacity)
+    : name(shm_name(name)), header(NULL), records(NULL), mapped(0), mask(0), next(0),
+      device(0), inode(0), linked(false) {
+
+    uint32_t cap = 1024;
+    while (cap < capacity && cap < (1U << 30)) {
+        cap <<= 1;
+    }
+    mask = cap - 1;
+    mapped = sizeof(shm_ring_header) + cap * sizeof(shm_tick_record);
+
+    // readers still attached to an old ring keep their mapping
+    shm_unlink(this->name.c_str());
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw shm_error("Failed to create shared memory", this->name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ftruncate(fd, mapped) != 0) {
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw shm_error("Failed to size shared memory", this->name);
+    }
+    void *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(this->name.c_str());
+        throw shm_error("Failed to map shared memory", this->name);
+    }
+
+    device = st.st_dev;
+    inode = st.st_ino;
+    linked = true;
+
+    header = (shm_ring_header *) base;
+    records = (shm_tick_record *) ((char *) base + sizeof(shm_ring_header));
+    header->capacity = cap;
+    header->record_size = sizeof(shm_tick_record);
+    header->version = SHM_RING_VERSION;
+    header->head = 0;
+    __sync_synchronize();
+    header->magic = SHM_RING_MAGIC;
+
+    pthread_mutex_init(&lock, NULL);
+}
+
+shm_tick_writer::~shm_tick_writer() {
+    munmap(header, mapped);
+    pthread_mutex_destroy(&lock);
+}
+
+void shm_tick_writer::unlink() {
+    if (! linked) {
+        return;
+    }
+    linked = false;
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    bool ours = fstat(fd, &st) == 0 && st.st_dev == device && st.st_ino == inode;
+    close(fd);
+    if (ours) {
+        shm_unlink(name.c_str());
+    }
+}
+
+static void copy_padded(char *dst, size_t len, const string &src) {
+    size_t n = src.size() < len ? src.size() : len;
+    memcpy(dst, src.data(), n);
+    memset(dst + n, 0, len - n);
+}
+
+void shm_tick_writer::publish(int type, int64_t ts, double price, int size,
+    const string &symbol, const string &exchange) {
+
+    pthread_mutex_lock(&lock);
+
+    uint32_t s = next;
+    shm_tick_record *rec = &records[s & mask];
+    rec->stamp = 2 * s + 1;
+    __sync_synchronize();
+
+    rec->type = type;
+    rec->ts = ts;
+    rec->price = price;
+    rec->size = size;
+    rec->reserved = 0;
+    copy_padded(rec->symbol, sizeof(rec->symbol), symbol);
+    copy_padded(rec->exchange, sizeof(rec->exchange), exchange);
+
+    __sync_synchronize();
+    rec->stamp = 2 * s + 2;
+    header->head = s + 1;
+    next = s + 1;
+
+    pthread_mutex_unlock(&lock);
+}
+
+shm_tick_reader::shm_tick_reader(const string &name)
+    : header(NULL), records(NULL), mapped(0), mask(0), capacity(0), position(0), dropped(0) {
+
+    string path = shm_name(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw shm_error("Failed to open shared memory", path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(shm_ring_header)) {
+        close(fd);
+        throw runtime_error("Not a tick ring: " + path);
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw shm_error("Failed to map shared memory", path);
+    }
+    mapped = st.st_size;
+
+    header = (const shm_ring_header *) base;
+    __sync_synchronize();
+    if (header->magic != SHM_RING_MAGIC
+        || header->version != SHM_RING_VERSION
+        || header->record_size != sizeof(shm_tick_record)
+        || mapped < sizeof(shm_ring_header) + header->capacity * sizeof(shm_tick_record)) {
+        munmap((void *) header, mapped);
+        throw runtime_error("Not a tick ring: " + path);
+    }
+
+    records = (const shm_tick_record *) ((const char *) base + sizeof(shm_ring_header));
+    capacity = header->capacity;
+    mask = capacity - 1;
+    position = header->head;
+}
+
+shm_tick_reader::~shm_tick_reader() {
+    munmap((void *) header, mapped);
+}
+
+int shm_tick_reader::read(shm_tick_record *out, int max) {
+    int n = 0;
+    while (n < max) {
+        uint32_t s = position;
+        const shm_tick_record *rec = &records[s & mask];
+        uint32_t expect = 2 * s + 2;
+
+        uint32_t before = rec->stamp;
+        __sync_synchronize();
+        int32_t ahead = (int32_t) (before - expect);
+        if (ahead < 0) {
+            // not published yet
+            break;
+        }
+        if (ahead == 0) {
+            memcpy(&out[n], (const void *) rec, sizeof(shm_tick_record));
+            __sync_synchronize();
+            if (rec->stamp == before) {
+                n ++;
+                position = s + 1;
+                continue;
+            }
+        }
+
+        // overwritten before or while we copied it: skip to the oldest
+        // record the writer cannot be touching
+        uint32_t oldest = header->head - capacity + 1;
+        int32_t behind = (int32_t) (oldest - s);
+        if (behind > 0) {
+            dropped += behind;
+            position = oldest;
+        } else {
+            position = s + 1;
+            dropped ++;
+        }
+    }
+    return n;
+}
+
+//############################################################################//
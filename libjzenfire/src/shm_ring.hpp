@@ -0,0 +1,132 @@
+
+//############################################################################//
+
+/** \file shm_ring.hpp
+ * \brief Single writer, multi reader tick broadcast ring in POSIX shared memory
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_SHM_RING_HPP
+#define JZENFIRE_SHM_RING_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <string>
+
+/**
+ * One tick as stored in the ring, 64 bytes. Readers get these copied out
+ * verbatim, in native byte order:
+ *
+ *   0  uint32 stamp      (internal)
+ *   4  int32  type
+ *   8  int64  ts         microseconds since the epoch
+ *   16 double price
+ *   24 int32  size
+ *   28 int32  reserved
+ *   32 char   symbol[24] NUL padded
+ *   56 char   exchange[8] NUL padded
+ */
+struct shm_tick_record {
+    volatile uint32_t stamp;
+    int32_t type;
+    int64_t ts;
+    double price;
+    int32_t size;
+    int32_t reserved;
+    char symbol[24];
+    char exchange[8];
+};
+
+struct shm_ring_header;
+
+/**
+ * The publishing side. Only one writer may exist per ring name; publish()
+ * is serialized internally so it can be called from any callback thread.
+ */
+class shm_tick_writer {
+    private:
+    std::string name;
+    shm_ring_header *header;
+    shm_tick_record *records;
+    size_t mapped;
+    uint32_t mask;
+    uint32_t next;
+    // identity of the ring created, so unlink() leaves a newer one alone
+    dev_t device;
+    ino_t inode;
+    bool linked;
+    pthread_mutex_t lock;
+
+    shm_tick_writer(const shm_tick_writer &);
+    shm_tick_writer& operator=(const shm_tick_writer &);
+
+    public:
+    /** Creates (or replaces) the ring; capacity is rounded up to a power of two. */
+    shm_tick_writer(const std::string &name, uint32_t capacity);
+    ~shm_tick_writer();
+
+    /**
+     * Removes the ring's name so no new reader can attach, unless the name
+     * has since been given to another ring. Readers already attached keep
+     * their mapping. The destructor does not unlink.
+     */
+    void unlink();
+
+    void publish(int type, int64_t ts, double price, int size,
+        const std::string &symbol, const std::string &exchange);
+};
+
+/**
+ * A read-only attachment to a ring. Each reader keeps its own position and
+ * starts at the writer's current head. A reader that falls more than the
+ * ring capacity behind skips to the oldest record still present and counts
+ * what it missed in lost().
+ */
+class shm_tick_reader {
+    private:
+    const shm_ring_header *header;
+    const shm_tick_record *records;
+    size_t mapped;
+    uint32_t mask;
+    uint32_t capacity;
+    uint32_t position;
+    uint64_t dropped;
+
+    shm_tick_reader(const shm_tick_reader &);
+    shm_tick_reader& operator=(const shm_tick_reader &);
+
+    public:
+    shm_tick_reader(const std::string &name);
+    ~shm_tick_reader();
+
+    /** Copies up to max records into out, returns the number copied. */
+    int read(shm_tick_record *out, int max);
+
+    uint64_t lost() const { return dropped; }
+};
+
+#endif
+
+//############################################################################//
@@ -0,0 +1,234 @@
+
+//############################################################################//
+
+/** \file synthetic.cpp
+ * \brief Synthetic spread instruments priced from their legs' ticks
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "synthetic.hpp"
+
+#include <cmath>
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+enum {
+    SIDE_BID = 0,
+    SIDE_ASK = 1,
+    SIDE_TRADE = 2
+};
+
+synthetic_book::synthetic_book() : count(0) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+synthetic_book::~synthetic_book() {
+    for (map<key_t, synthetic_t *>::iterator it = synthetics.begin(); it != synthetics.end(); ++ it) {
+        delete it->second;
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+void synthetic_book::unlink(synthetic_t *syn, const vector<key_t> &keys) {
+    for (size_t i = 0; i < keys.size(); i ++) {
+        map<key_t, uses_t>::iterator it = legs.find(keys[i]);
+        if (it != legs.end()) {
+            uses_t &uses = it->second;
+            for (size_t j = uses.size(); j -- > 0; ) {
+                if (uses[j].first == syn) {
+                    uses.erase(uses.begin() + j);
+                }
+            }
+            if (uses.empty()) {
+                legs.erase(it);
+            }
+        }
+        if (syn->suppress_legs) {
+            map<key_t, int>::iterator s = suppressed.find(keys[i]);
+            if (s != suppressed.end() && -- s->second == 0) {
+                suppressed.erase(s);
+            }
+        }
+    }
+}
+
+void synthetic_book::define(const string &symbol, const string &exchange,
+    const vector<synthetic_leg> &leg_defs, const synthetic_types &types,
+    double increment, bool suppress_legs) {
+
+    if (leg_defs.empty()) {
+        throw std::invalid_argument("Synthetic " + symbol + " has no legs");
+    }
+    for (size_t i = 0; i < leg_defs.size(); i ++) {
+        if (leg_defs[i].weight == 0.0 || leg_defs[i].weight != leg_defs[i].weight) {
+            throw std::invalid_argument("Synthetic " + symbol + " has a leg without a weight");
+        }
+    }
+
+    synthetic_t *syn = new synthetic_t();
+    syn->symbol = symbol;
+    syn->exchange = exchange;
+    syn->types = types;
+    syn->increment = increment;
+    syn->suppress_legs = suppress_legs;
+    syn->legs.resize(leg_defs.size());
+    for (size_t i = 0; i < leg_defs.size(); i ++) {
+        syn->legs[i].weight = leg_defs[i].weight;
+    }
+
+    pthread_mutex_lock(&lock);
+    synthetic_t *old = detach(key_t(symbol, exchange));
+    synthetics[key_t(symbol, exchange)] = syn;
+    // suppression is counted once per instrument, as unlink() releases it
+    set<key_t> keys;
+    for (size_t i = 0; i < leg_defs.size(); i ++) {
+        key_t key(leg_defs[i].symbol, leg_defs[i].exchange);
+        legs[key].push_back(make_pair(syn, i));
+        if (suppress_legs && keys.insert(key).second) {
+            suppressed[key] ++;
+        }
+    }
+    count = synthetics.size();
+    pthread_mutex_unlock(&lock);
+
+    delete old;
+}
+
+synthetic_book::synthetic_t *synthetic_book::detach(const key_t &key) {
+    map<key_t, synthetic_t *>::iterator it = synthetics.find(key);
+    if (it == synthetics.end()) {
+        return NULL;
+    }
+    synthetic_t *syn = it->second;
+    synthetics.erase(it);
+
+    vector<key_t> keys;
+    for (map<key_t, uses_t>::iterator l = legs.begin(); l != legs.end(); ++ l) {
+        for (size_t j = 0; j < l->second.size(); j ++) {
+            if (l->second[j].first == syn) {
+                keys.push_back(l->first);
+                break;
+            }
+        }
+    }
+    unlink(syn, keys);
+    count = synthetics.size();
+    return syn;
+}
+
+bool synthetic_book::remove(const string &symbol, const string &exchange) {
+    pthread_mutex_lock(&lock);
+    synthetic_t *syn = detach(key_t(symbol, exchange));
+    pthread_mutex_unlock(&lock);
+
+    delete syn;
+    return syn != NULL;
+}
+
+void synthetic_book::imply(synthetic_t &syn, int side, int64_t ts, vector<synthetic_tick> &out) {
+    double price = 0.0;
+    int32_t size = -1;
+
+    for (size_t i = 0; i < syn.legs.size(); i ++) {
+        const leg_state_t &leg = syn.legs[i];
+        const quote_t &q = side == SIDE_TRADE ? leg.last
+            : (side == SIDE_BID) == (leg.weight > 0.0) ? leg.bid : leg.ask;
+        if (! q.known) {
+            return;
+        }
+        price += leg.weight * q.price;
+        int32_t leg_size = (int32_t) floor(q.size / fabs(leg.weight));
+        if (size < 0 || leg_size < size) {
+            size = leg_size;
+        }
+    }
+
+    quote_t &last = syn.implied[side];
+    if (last.known && last.price == price) {
+        return;
+    }
+    last.known = true;
+    last.price = price;
+    last.size = size;
+
+    synthetic_tick t;
+    t.symbol = syn.symbol;
+    t.exchange = syn.exchange;
+    t.type = side == SIDE_BID ? syn.types.bid : side == SIDE_ASK ? syn.types.ask : syn.types.trade;
+    t.ts = ts;
+    t.price = price;
+    t.size = size;
+    t.increment = syn.increment;
+    out.push_back(t);
+}
+
+bool synthetic_book::tick(const string &symbol, const string &exchange,
+    int type, int64_t ts, double price, int32_t size, vector<synthetic_tick> &out) {
+
+    if (count == 0) {
+        return false;
+    }
+
+    key_t key(symbol, exchange);
+    pthread_mutex_lock(&lock);
+    map<key_t, uses_t>::iterator it = legs.find(key);
+    if (it == legs.end()) {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+
+    uses_t &uses = it->second;
+    for (size_t i = 0; i < uses.size(); i ++) {
+        synthetic_t &syn = *uses[i].first;
+        leg_state_t &leg = syn.legs[uses[i].second];
+        quote_t *q;
+        if (type == syn.types.bid) {
+            q = &leg.bid;
+        } else if (type == syn.types.ask) {
+            q = &leg.ask;
+        } else if (type == syn.types.trade) {
+            q = &leg.last;
+        } else {
+            continue;
+        }
+        q->known = true;
+        q->price = price;
+        q->size = size;
+
+        if (q == &leg.last) {
+            imply(syn, SIDE_TRADE, ts, out);
+        } else {
+            // a leg's bid feeds the implied bid or ask depending on its sign
+            imply(syn, SIDE_BID, ts, out);
+            imply(syn, SIDE_ASK, ts, out);
+        }
+    }
+
+    bool suppress = suppressed.find(key) != suppressed.end();
+    pthread_mutex_unlock(&lock);
+    return suppress;
+}
+
+//############################################################################//
@@ -0,0 +1,153 @@
+
+//############################################################################//
+
+/** \file synthetic.hpp
+ * \brief Synthetic spread instruments priced from their legs' ticks
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_SYNTHETIC_HPP
+#define JZENFIRE_SYNTHETIC_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+struct synthetic_leg {
+    std::string symbol;
+    std::string exchange;
+    double weight;
+};
+
+/** Tick types of the feed, as the caller knows them. */
+struct synthetic_types {
+    int bid;
+    int ask;
+    int trade;
+};
+
+/** An implied tick to hand on under the synthetic's name. */
+struct synthetic_tick {
+    std::string symbol;
+    std::string exchange;
+    int type;
+    int64_t ts;
+    double price;
+    int32_t size;
+    // the synthetic's price increment, 0 if not known
+    double increment;
+};
+
+/**
+ * Synthetic instruments priced as a weighted sum of legs, for calendar and
+ * ratio spreads. A leg with a positive weight is bought, so the implied bid
+ * uses its bid and the implied ask its ask; a negative weight sells and
+ * swaps them. The implied last is the weighted sum of the legs' last
+ * trades. Implied sizes are the smallest leg size divided by the leg's
+ * absolute weight.
+ *
+ * Nothing is implied until every leg has quoted the side(s) needed, and a
+ * synthetic tick is produced only when its implied price changes; it
+ * carries the implied size at that moment.
+ * Thread safe.
+ */
+class synthetic_book {
+    private:
+    struct quote_t {
+        bool known;
+        double price;
+        int32_t size;
+
+        quote_t() : known(false), price(0.0), size(0) { }
+    };
+
+    struct leg_state_t {
+        double weight;
+        quote_t bid;
+        quote_t ask;
+        quote_t last;
+    };
+
+    struct synthetic_t {
+        std::string symbol;
+        std::string exchange;
+        synthetic_types types;
+        double increment;
+        bool suppress_legs;
+        std::vector<leg_state_t> legs;
+        // last emitted, by bid, ask and trade
+        quote_t implied[3];
+    };
+
+    typedef std::pair<std::string, std::string> key_t;
+    typedef std::vector<std::pair<synthetic_t *, size_t> > uses_t;
+
+    pthread_mutex_t lock;
+    std::map<key_t, synthetic_t *> synthetics;
+    // leg instrument -> (synthetic, leg index)
+    std::map<key_t, uses_t> legs;
+    // leg instrument -> number of suppressing synthetics using it
+    std::map<key_t, int> suppressed;
+    volatile int count;
+
+    synthetic_book(const synthetic_book &);
+    synthetic_book& operator=(const synthetic_book &);
+
+    void unlink(synthetic_t *syn, const std::vector<key_t> &keys);
+    synthetic_t *detach(const key_t &key);
+    static void imply(synthetic_t &syn, int side, int64_t ts, std::vector<synthetic_tick> &out);
+
+    public:
+    synthetic_book();
+    ~synthetic_book();
+
+    /**
+     * Defines or replaces the synthetic (symbol, exchange). increment is
+     * handed on with its implied ticks for tick unit pricing, 0 if unknown.
+     * A leg listed more than once is one instrument with several uses.
+     */
+    void define(const std::string &symbol, const std::string &exchange,
+        const std::vector<synthetic_leg> &legs, const synthetic_types &types,
+        double increment, bool suppress_legs);
+
+    /** Returns false if there was no such synthetic. */
+    bool remove(const std::string &symbol, const std::string &exchange);
+
+    bool empty() const { return count == 0; }
+
+    /**
+     * Feeds one tick of an instrument. Implied ticks it causes are appended
+     * to out. Returns true if the tick itself should be withheld from Java
+     * because a synthetic using it as a leg suppresses its legs.
+     */
+    bool tick(const std::string &symbol, const std::string &exchange,
+        int type, int64_t ts, double price, int32_t size, std::vector<synthetic_tick> &out);
+};
+
+#endif
+
+//############################################################################//
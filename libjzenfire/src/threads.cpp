@@ -0,0 +1,230 @@
+
+//############################################################################//
+
+/** \file threads.cpp
+ * \brief CPU pinning, scheduling and wait strategies for native threads
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "threads.hpp"
+
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+#include <stdexcept>
+
+using namespace std;
+
+thread_role_t callback_threads(0);
+thread_role_t dispatch_threads(1);
+thread_role_t sender_threads(2);
+
+volatile int wait_mode = WAIT_PARK;
+
+// generation each role was last applied at on this thread, 0 for never;
+// roles start at generation 0 so nothing is applied until an option is set
+static __thread uint32_t applied[3];
+
+thread_role_t::thread_role_t(int slot)
+    : cpu_(-1), priority_(0), cpu_set(0), priority_set(0), generation(0), failures_(0), slot(slot) { }
+
+void thread_role_t::enter() {
+    if (applied[slot] != generation) {
+        apply();
+    }
+}
+
+void thread_role_t::apply() {
+    uint32_t gen = generation;
+    int cpu = cpu_;
+    int priority = priority_;
+
+    if (cpu_set) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (cpu >= 0) {
+            CPU_SET(cpu, &set);
+        } else {
+            long n = sysconf(_SC_NPROCESSORS_CONF);
+            for (long i = 0; i < n && i < CPU_SETSIZE; i ++) {
+                CPU_SET(i, &set);
+            }
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            __sync_add_and_fetch(&failures_, 1);
+        }
+    }
+
+    if (priority_set) {
+        struct sched_param param;
+        param.sched_priority = priority;
+        if (pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param) != 0) {
+            __sync_add_and_fetch(&failures_, 1);
+        }
+    }
+
+    applied[slot] = gen;
+}
+
+void thread_role_t::cpu(int cpu) {
+    if (cpu < -1 || cpu >= CPU_SETSIZE) {
+        throw invalid_argument("cpu out of range");
+    }
+    cpu_ = cpu;
+    cpu_set = 1;
+    __sync_add_and_fetch(&generation, 1);
+}
+
+void thread_role_t::priority(int priority) {
+    if (priority < 0 || priority > sched_get_priority_max(SCHED_FIFO)) {
+        throw invalid_argument("priority out of range");
+    }
+    priority_ = priority;
+    priority_set = 1;
+    __sync_add_and_fetch(&generation, 1);
+}
+
+signal_t::signal_t() : seq(0), sleepers(0) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+signal_t::~signal_t() {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+}
+
+void signal_t::notify() {
+    __sync_add_and_fetch(&seq, 1);
+    if (sleepers > 0) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void signal_t::wait(uint32_t seen, long timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec ++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    int mode = wait_mode;
+    if (mode != WAIT_PARK) {
+        struct timespec now;
+        while (seq == seen) {
+            if (mode == WAIT_YIELD) {
+                sched_yield();
+            } else {
+#if defined(__i386__) || defined(__x86_64__)
+                __asm__ __volatile__("pause" ::: "memory");
+#endif
+            }
+            if (timeout_ms > 0) {
+                clock_gettime(CLOCK_REALTIME, &now);
+                if (now.tv_sec > deadline.tv_sec
+                    || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+                    return;
+                }
+            }
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    __sync_add_and_fetch(&sleepers, 1);
+    int rc = 0;
+    while (seq == seen && rc != ETIMEDOUT) {
+        rc = timeout_ms > 0
+            ? pthread_cond_timedwait(&cond, &lock, &deadline)
+            : pthread_cond_wait(&cond, &lock);
+    }
+    __sync_sub_and_fetch(&sleepers, 1);
+    pthread_mutex_unlock(&lock);
+}
+
+static thread_role_t *role_for(const string &option, string &setting) {
+    static const char *names[] = { "jzenfire.callback.", "jzenfire.dispatch.", "jzenfire.sender." };
+    static thread_role_t *roles[] = { &callback_threads, &dispatch_threads, &sender_threads };
+    for (int i = 0; i < 3; i ++) {
+        string prefix(names[i]);
+        if (option.compare(0, prefix.size(), prefix) == 0) {
+            setting = option.substr(prefix.size());
+            return roles[i];
+        }
+    }
+    return NULL;
+}
+
+bool get_thread_option(const string &option, int &value) {
+    if (option == "jzenfire.wait_mode") {
+        value = wait_mode;
+        return true;
+    }
+    string setting;
+    thread_role_t *role = role_for(option, setting);
+    if (role == NULL) {
+        return false;
+    }
+    if (setting == "cpu") {
+        value = role->cpu();
+    } else if (setting == "priority") {
+        value = role->priority();
+    } else if (setting == "failures") {
+        value = (int) role->failures();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool set_thread_option(const string &option, int value) {
+    if (option == "jzenfire.wait_mode") {
+        if (value != WAIT_PARK && value != WAIT_YIELD && value != WAIT_SPIN) {
+            throw invalid_argument("jzenfire.wait_mode must be 0 (park), 1 (yield) or 2 (spin)");
+        }
+        wait_mode = value;
+        return true;
+    }
+    string setting;
+    thread_role_t *role = role_for(option, setting);
+    if (role == NULL) {
+        return false;
+    }
+    if (setting == "cpu") {
+        role->cpu(value);
+    } else if (setting == "priority") {
+        role->priority(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//############################################################################//
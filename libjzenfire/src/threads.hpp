@@ -0,0 +1,127 @@
+
+//############################################################################//
+
+/** \file threads.hpp
+ * \brief CPU pinning, scheduling and wait strategies for native threads
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_THREADS_HPP
+#define JZENFIRE_THREADS_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+
+/**
+ * Placement for one class of native thread: the libzenfire threads running
+ * our callbacks, the binding's dispatch threads and its sender threads.
+ * Settings are process wide. Threads pick up a change the next time they
+ * call enter(), which costs one thread-local compare when nothing changed.
+ * Affinity and scheduling are left as the host application set them until
+ * the matching option is first set for the role.
+ */
+class thread_role_t {
+    private:
+    volatile int cpu_;
+    volatile int priority_;
+    volatile int cpu_set;
+    volatile int priority_set;
+    volatile uint32_t generation;
+    volatile uint32_t failures_;
+    int slot;
+
+    thread_role_t(const thread_role_t &);
+    thread_role_t& operator=(const thread_role_t &);
+
+    void apply();
+
+    public:
+    thread_role_t(int slot);
+
+    /** Applies the current settings to the calling thread if they changed. */
+    void enter();
+
+    /** CPU to pin to, -1 for any. */
+    int cpu() const { return cpu_; }
+    void cpu(int cpu);
+
+    /** SCHED_FIFO priority 1-99, 0 for the default scheduler. */
+    int priority() const { return priority_; }
+    void priority(int priority);
+
+    /** Number of times pinning or scheduling a thread failed. */
+    uint32_t failures() const { return failures_; }
+};
+
+extern thread_role_t callback_threads;
+extern thread_role_t dispatch_threads;
+extern thread_role_t sender_threads;
+
+enum wait_mode_t {
+    WAIT_PARK = 0,
+    WAIT_YIELD = 1,
+    WAIT_SPIN = 2
+};
+
+/** How native queue consumers wait for work, process wide. */
+extern volatile int wait_mode;
+
+/**
+ * Wakes consumers of a native queue. Producers call notify() after
+ * publishing; consumers take current() before checking for work and call
+ * wait() with it when there is none, which returns on any later notify()
+ * or after timeout_ms (0 waits indefinitely). Parked consumers sleep on a
+ * futex-backed condition variable; notify() only takes the lock when
+ * someone is parked.
+ */
+class signal_t {
+    private:
+    volatile uint32_t seq;
+    volatile int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    signal_t(const signal_t &);
+    signal_t& operator=(const signal_t &);
+
+    public:
+    signal_t();
+    ~signal_t();
+
+    uint32_t current() const { return seq; }
+    void notify();
+    void wait(uint32_t seen, long timeout_ms);
+};
+
+/**
+ * Handles "jzenfire.{callback,dispatch,sender}.{cpu,priority,failures}" and
+ * "jzenfire.wait_mode". Returns false for options it does not know.
+ */
+bool get_thread_option(const std::string &option, int &value);
+bool set_thread_option(const std::string &option, int value);
+
+#endif
+
+//############################################################################//
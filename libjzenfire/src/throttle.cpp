@@ -0,0 +1,414 @@
+
+//############################################################################//
+
+/** \file throttle.cpp
+ * \brief Per-account and per-instrument pacing of order actions
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "throttle.hpp"
+
+#include <zenfire/product.hpp>
+
+#include <time.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+order_throttle_t &throttle = *new order_throttle_t();
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void perform(const zenfire::order_ptr &order, throttle_op_t op, const string &reason) {
+    switch (op) {
+        case THROTTLE_SEND: order->send(); break;
+        case THROTTLE_UPDATE: order->update(); break;
+        case THROTTLE_CANCEL: order->cancel(reason); break;
+    }
+}
+
+static string instrument_key(const string &symbol, const string &exchange) {
+    return symbol + "@" + exchange;
+}
+
+static token_bucket_t *bucket(map<string, token_bucket_t> &buckets, const string &key) {
+    map<string, token_bucket_t>::iterator it = buckets.find(key);
+    return it == buckets.end() ? NULL : &it->second;
+}
+
+void token_bucket_t::refill(int64_t now) {
+    tokens += (now - last) * rate / 1e9;
+    if (tokens > burst) {
+        tokens = burst;
+    }
+    last = now;
+}
+
+order_throttle_t::order_throttle_t()
+    : limits(0), backlog(0), queued_cancels(0), queued_others(0), running(NULL), started(false),
+      sent_now(0), sent_later(0), failures(0), delay_ns(0), max_delay_ns(0) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+/** Refills the action's buckets; the wait in ns until all have a token. */
+int64_t order_throttle_t::wait_ns(const action_t &a, int64_t now) {
+    token_bucket_t *acct = bucket(accounts, a.account);
+    token_bucket_t *inst = bucket(instruments, a.instrument);
+    int64_t wait = 0;
+    if (acct != NULL) {
+        acct->refill(now);
+        wait = max(wait, acct->wait_ns());
+    }
+    if (inst != NULL) {
+        inst->refill(now);
+        wait = max(wait, inst->wait_ns());
+    }
+    return wait;
+}
+
+void order_throttle_t::take(const action_t &a) {
+    token_bucket_t *acct = bucket(accounts, a.account);
+    token_bucket_t *inst = bucket(instruments, a.instrument);
+    if (acct != NULL) acct->take();
+    if (inst != NULL) inst->take();
+}
+
+void order_throttle_t::refund(const action_t &a) {
+    token_bucket_t *acct = bucket(accounts, a.account);
+    token_bucket_t *inst = bucket(instruments, a.instrument);
+    if (acct != NULL) acct->refund();
+    if (inst != NULL) inst->refund();
+}
+
+void order_throttle_t::count_in(map<string, queued_t> &queued, const string &key, bool cancel, int delta) {
+    queued_t &q = queued[key];
+    q.all += delta;
+    if (cancel) {
+        q.cancels += delta;
+    }
+    if (q.all == 0) {
+        queued.erase(key);
+    }
+}
+
+/** Adds delta to the counts an action queued in the given lane is part of. */
+void order_throttle_t::count(const action_t &a, bool cancel_lane, int delta) {
+    count_in(account_queued, a.account, cancel_lane, delta);
+    count_in(instrument_queued, a.instrument, cancel_lane, delta);
+    if (cancel_lane) {
+        queued_cancels += delta;
+    } else {
+        int &n = order_queued[a.order.get()];
+        n += delta;
+        if (n == 0) {
+            order_queued.erase(a.order.get());
+        }
+        queued_others += delta;
+    }
+    backlog = (int) (queued_cancels + queued_others);
+}
+
+void order_throttle_t::recount() {
+    account_queued.clear();
+    instrument_queued.clear();
+    order_queued.clear();
+    queued_cancels = 0;
+    queued_others = 0;
+    for (map<chain_key_t, chain_t>::iterator c = chains.begin(); c != chains.end(); ++ c) {
+        for (size_t i = 0; i < c->second.cancels.size(); i ++) {
+            count(c->second.cancels[i], true, 1);
+        }
+        for (size_t i = 0; i < c->second.others.size(); i ++) {
+            count(c->second.others[i], false, 1);
+        }
+    }
+    backlog = (int) (queued_cancels + queued_others);
+}
+
+/**
+ * Whether a queued action would run before a: one for the same order, or
+ * one sharing a limited bucket with it. Queued sends and modifies are not
+ * ahead of a cancel.
+ */
+bool order_throttle_t::waiting_ahead(const action_t &a) const {
+    bool cancel = a.op == THROTTLE_CANCEL;
+    if (order_queued.find(a.order.get()) != order_queued.end()) {
+        return true;
+    }
+    // a queued cancel for the same order is in the same chain
+    map<chain_key_t, chain_t>::const_iterator c = chains.find(chain_key_t(a.account, a.instrument));
+    if (c != chains.end() && (! c->second.cancels.empty() || (! cancel && ! c->second.others.empty()))) {
+        return true;
+    }
+    if (accounts.find(a.account) != accounts.end()) {
+        map<string, queued_t>::const_iterator q = account_queued.find(a.account);
+        if (q != account_queued.end() && (cancel ? q->second.cancels : q->second.all) > 0) {
+            return true;
+        }
+    }
+    if (instruments.find(a.instrument) != instruments.end()) {
+        map<string, queued_t>::const_iterator q = instrument_queued.find(a.instrument);
+        if (q != instrument_queued.end() && (cancel ? q->second.cancels : q->second.all) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+order_throttle_t::action_t order_throttle_t::describe(throttle_owner_t *owner, const zenfire::order_ptr &order,
+    throttle_op_t op, const string &reason) {
+
+    action_t a;
+    a.order = order;
+    a.op = op;
+    a.reason = reason;
+    a.account = order->acct();
+    a.instrument = instrument_key(order->product().symbol,
+        zenfire::exchange::to_string(order->product().exchange));
+    a.owner = owner;
+    return a;
+}
+
+void order_throttle_t::enqueue(const action_t &a) {
+    // a cancel waits behind a send or modify of its order
+    bool cancel_lane = a.op == THROTTLE_CANCEL
+        && order_queued.find(a.order.get()) == order_queued.end();
+    chain_t &c = chains[chain_key_t(a.account, a.instrument)];
+    (cancel_lane ? c.cancels : c.others).push_back(a);
+    count(a, cancel_lane, 1);
+}
+
+/**
+ * Takes the next action that may go now, the longest waiting of the chain
+ * heads that have tokens, cancels first; else sets wait (-1 for none queued).
+ */
+bool order_throttle_t::next(action_t &out, int64_t &wait) {
+    pthread_mutex_lock(&lock);
+    int64_t now = now_ns();
+    wait = -1;
+    for (int lane = 0; lane < 2; lane ++) {
+        map<chain_key_t, chain_t>::iterator best = chains.end();
+        for (map<chain_key_t, chain_t>::iterator c = chains.begin(); c != chains.end(); ++ c) {
+            deque<action_t> &q = lane == 0 ? c->second.cancels : c->second.others;
+            if (q.empty()) {
+                continue;
+            }
+            int64_t w = wait_ns(q.front(), now);
+            if (w == 0) {
+                if (best == chains.end()
+                    || q.front().queued < (lane == 0 ? best->second.cancels : best->second.others).front().queued) {
+                    best = c;
+                }
+            } else if (wait < 0 || w < wait) {
+                wait = w;
+            }
+        }
+        if (best != chains.end()) {
+            deque<action_t> &q = lane == 0 ? best->second.cancels : best->second.others;
+            out = q.front();
+            q.pop_front();
+            take(out);
+            count(out, lane == 0, -1);
+            if (best->second.cancels.empty() && best->second.others.empty()) {
+                chains.erase(best);
+            }
+            running = out.owner;
+            int64_t delay = now - out.queued;
+            delay_ns += delay;
+            if (delay > max_delay_ns) {
+                max_delay_ns = delay;
+            }
+            pthread_mutex_unlock(&lock);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return false;
+}
+
+void order_throttle_t::set_rate(map<string, token_bucket_t> &buckets, const string &key, double rate, int burst) {
+    pthread_mutex_lock(&lock);
+    if (rate <= 0.0) {
+        buckets.erase(key);
+    } else {
+        buckets[key] = token_bucket_t(rate, burst > 0 ? burst : 1, now_ns());
+    }
+    limits = accounts.size() + instruments.size();
+    pthread_mutex_unlock(&lock);
+    // waiting actions may be able to go sooner
+    signal.notify();
+}
+
+void *order_throttle_t::run(void *self) {
+    ((order_throttle_t *) self)->loop();
+    return NULL;
+}
+
+void order_throttle_t::loop() {
+    for (;;) {
+        sender_threads.enter();
+        uint32_t seen = signal.current();
+        action_t a;
+        int64_t wait;
+        if (next(a, wait)) {
+            bool failed = false;
+            try {
+                perform(a.order, a.op, a.reason);
+            } catch (exception &ex) {
+                failed = true;
+                if (a.owner != NULL) {
+                    try {
+                        a.owner->queued_action_failed(a.order, a.op, ex.what());
+                    } catch (exception &) {
+                        // the failure is still counted
+                    }
+                }
+            }
+            // the order goes before forget() can let its client be freed
+            a.order.reset();
+            pthread_mutex_lock(&lock);
+            running = NULL;
+            if (failed) {
+                refund(a);
+                failures ++;
+            } else {
+                sent_later ++;
+            }
+            pthread_mutex_unlock(&lock);
+            idle.notify();
+            continue;
+        }
+        signal.wait(seen, wait < 0 ? 0 : (long) (wait / 1000000) + 1);
+    }
+}
+
+void order_throttle_t::account_rate(const string &account, double rate, int burst) {
+    set_rate(accounts, account, rate, burst);
+}
+
+void order_throttle_t::instrument_rate(const string &symbol, const string &exchange, double rate, int burst) {
+    set_rate(instruments, instrument_key(symbol, exchange), rate, burst);
+}
+
+void order_throttle_t::forget(throttle_owner_t *owner) {
+    pthread_mutex_lock(&lock);
+    for (map<chain_key_t, chain_t>::iterator c = chains.begin(); c != chains.end(); ) {
+        deque<action_t> *lanes[] = { &c->second.cancels, &c->second.others };
+        for (int lane = 0; lane < 2; lane ++) {
+            deque<action_t> &q = *lanes[lane];
+            for (size_t i = q.size(); i -- > 0; ) {
+                if (q[i].owner == owner) {
+                    q.erase(q.begin() + i);
+                }
+            }
+        }
+        if (c->second.cancels.empty() && c->second.others.empty()) {
+            chains.erase(c ++);
+        } else {
+            ++ c;
+        }
+    }
+    recount();
+    // a failure callback freeing its own client runs on the sender thread
+    while (running == owner && ! (started && pthread_equal(pthread_self(), thread))) {
+        uint32_t seen = idle.current();
+        pthread_mutex_unlock(&lock);
+        idle.wait(seen, 0);
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void order_throttle_t::submit(throttle_owner_t *owner, const zenfire::order_ptr &order, throttle_op_t op, const string &reason) {
+    if (limits == 0 && backlog == 0) {
+        perform(order, op, reason);
+        return;
+    }
+
+    action_t a = describe(owner, order, op, reason);
+
+    pthread_mutex_lock(&lock);
+    a.queued = now_ns();
+    if (waiting_ahead(a) || wait_ns(a, a.queued) != 0) {
+        queue(a);
+        return;
+    }
+    take(a);
+    pthread_mutex_unlock(&lock);
+
+    try {
+        perform(order, op, reason);
+    } catch (...) {
+        pthread_mutex_lock(&lock);
+        refund(a);
+        pthread_mutex_unlock(&lock);
+        throw;
+    }
+    pthread_mutex_lock(&lock);
+    sent_now ++;
+    pthread_mutex_unlock(&lock);
+}
+
+void order_throttle_t::defer(throttle_owner_t *owner, const zenfire::order_ptr &order, throttle_op_t op, const string &reason) {
+    action_t a = describe(owner, order, op, reason);
+
+    pthread_mutex_lock(&lock);
+    a.queued = now_ns();
+    queue(a);
+}
+
+/** Queues the action, starting the sender thread if need be. Call with lock held; releases it. */
+void order_throttle_t::queue(const action_t &a) {
+    if (! started) {
+        if (pthread_create(&thread, NULL, run, this) != 0) {
+            pthread_mutex_unlock(&lock);
+            throw std::runtime_error("Failed to start order throttle thread");
+        }
+        pthread_detach(thread);
+        started = true;
+    }
+    enqueue(a);
+    pthread_mutex_unlock(&lock);
+    signal.notify();
+}
+
+void order_throttle_t::stats(int64_t out[7]) {
+    pthread_mutex_lock(&lock);
+    out[0] = queued_cancels;
+    out[1] = queued_others;
+    out[2] = sent_now;
+    out[3] = sent_later;
+    out[4] = failures;
+    int64_t dequeued = sent_later + failures;
+    out[5] = dequeued > 0 ? delay_ns / dequeued : 0;
+    out[6] = max_delay_ns;
+    pthread_mutex_unlock(&lock);
+}
+
+//############################################################################//
@@ -0,0 +1,233 @@
+
+//############################################################################//
+
+/** \file throttle.hpp
+ * \brief Per-account and per-instrument pacing of order actions
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_THROTTLE_HPP
+#define JZENFIRE_THROTTLE_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <zenfire/client.hpp>
+
+#include "threads.hpp"
+
+#include <string>
+#include <map>
+#include <deque>
+#include <utility>
+
+enum throttle_op_t {
+    THROTTLE_SEND,
+    THROTTLE_UPDATE,
+    THROTTLE_CANCEL
+};
+
+/**
+ * The client an order belongs to, told when a queued action for one of its
+ * orders fails. Called on the throttle's sender thread.
+ */
+class throttle_owner_t {
+    public:
+    virtual ~throttle_owner_t() { }
+    virtual void queued_action_failed(const zenfire::order_ptr &order, throttle_op_t op, const std::string &what) = 0;
+};
+
+/**
+ * Token bucket: rate messages a second on average, up to burst at once.
+ */
+class token_bucket_t {
+    private:
+    double rate;
+    double burst;
+    double tokens;
+    int64_t last;
+
+    public:
+    token_bucket_t() : rate(0.0), burst(0.0), tokens(0.0), last(0) { }
+    token_bucket_t(double rate, double burst, int64_t now)
+        : rate(rate), burst(burst), tokens(burst), last(now) { }
+
+    void refill(int64_t now);
+
+    /** Nanoseconds until a token is available, 0 if one is. */
+    int64_t wait_ns() const {
+        return tokens >= 1.0 ? 0 : (int64_t) ((1.0 - tokens) / rate * 1e9) + 1;
+    }
+
+    void take() { tokens -= 1.0; }
+
+    /** Returns a token taken for an action that failed. */
+    void refund() {
+        tokens += 1.0;
+        if (tokens > burst) {
+            tokens = burst;
+        }
+    }
+};
+
+/**
+ * Paces order sends, modifies and cancels to per-account and per-instrument
+ * message rates, process wide, for the Java and C clients alike. With no
+ * rate set every submitted action runs right away on the caller's thread;
+ * deferred ones always go to the sender thread. Otherwise
+ * an action runs inline when its own buckets have tokens and no queued
+ * action for the same order or the same limited bucket is ahead of it, and
+ * is queued for the throttle's sender thread when not; actions under other
+ * limits, or none, are not held up by a backlog.
+ *
+ * The sender thread runs queued cancels before anything else, then other
+ * actions in order. A cancel for an order that still has a send or modify
+ * queued waits behind them. Actions queue by account and instrument, so
+ * picking the next one looks only at the head of each queue. Errors from
+ * actions run inline are thrown to the caller; those from queued actions go
+ * to the order's owner. A failed action gives its tokens back.
+ *
+ * Each action names the client owning its order. Nothing is recorded for
+ * actions that run inline; a queued one keeps its owner until it has run,
+ * and forgetting the owner drops its queued actions before the client can
+ * be freed.
+ */
+class order_throttle_t {
+    private:
+    struct action_t {
+        zenfire::order_ptr order;
+        throttle_op_t op;
+        std::string reason;
+        std::string account;
+        std::string instrument;
+        throttle_owner_t *owner;
+        int64_t queued;
+    };
+
+    typedef std::pair<std::string, std::string> chain_key_t;
+
+    /**
+     * The queued actions of one account and instrument, in order. Everything
+     * in a lane shares its head's buckets, so only the heads can go next.
+     */
+    struct chain_t {
+        std::deque<action_t> cancels;
+        std::deque<action_t> others;
+    };
+
+    /** Queued actions under one bucket, and how many of them are cancels. */
+    struct queued_t {
+        int all;
+        int cancels;
+
+        queued_t() : all(0), cancels(0) { }
+    };
+
+    pthread_mutex_t lock;
+    std::map<std::string, token_bucket_t> accounts;
+    std::map<std::string, token_bucket_t> instruments;
+    volatile int limits;
+    volatile int backlog;
+    std::map<chain_key_t, chain_t> chains;
+    std::map<std::string, queued_t> account_queued;
+    std::map<std::string, queued_t> instrument_queued;
+    // orders with a send or modify queued, and how many
+    std::map<const void *, int> order_queued;
+    int64_t queued_cancels;
+    int64_t queued_others;
+    signal_t signal;
+    // owner of the action the sender thread is running, if any
+    throttle_owner_t *running;
+    signal_t idle;
+    bool started;
+    pthread_t thread;
+
+    int64_t sent_now;
+    int64_t sent_later;
+    int64_t failures;
+    int64_t delay_ns;
+    int64_t max_delay_ns;
+
+    order_throttle_t(const order_throttle_t &);
+    order_throttle_t& operator=(const order_throttle_t &);
+
+    int64_t wait_ns(const action_t &a, int64_t now);
+    void take(const action_t &a);
+    void refund(const action_t &a);
+    static void count_in(std::map<std::string, queued_t> &queued, const std::string &key, bool cancel, int delta);
+    void count(const action_t &a, bool cancel_lane, int delta);
+    void recount();
+    static action_t describe(throttle_owner_t *owner, const zenfire::order_ptr &order, throttle_op_t op,
+        const std::string &reason);
+    bool waiting_ahead(const action_t &a) const;
+    void enqueue(const action_t &a);
+    void queue(const action_t &a);
+    bool next(action_t &out, int64_t &wait);
+    void set_rate(std::map<std::string, token_bucket_t> &buckets, const std::string &key, double rate, int burst);
+    static void *run(void *self);
+    void loop();
+
+    public:
+    order_throttle_t();
+
+    /** A rate <= 0 removes the limit. */
+    void account_rate(const std::string &account, double rate, int burst);
+    void instrument_rate(const std::string &symbol, const std::string &exchange, double rate, int burst);
+
+    bool limited() const { return limits != 0; }
+
+    /**
+     * Drops the owner's queued actions, and waits for the
+     * sender thread to finish any action of the owner's it is running.
+     * Call before freeing the owner's client.
+     */
+    void forget(throttle_owner_t *owner);
+
+    /**
+     * Runs the action now or queues it. owner, which may be NULL, hears of
+     * the failure if a queued action fails.
+     */
+    void submit(throttle_owner_t *owner, const zenfire::order_ptr &order, throttle_op_t op,
+        const std::string &reason = std::string());
+
+    /**
+     * Queues the action for the sender thread whatever the limits, for
+     * callers such as libzenfire's callback threads that must not block on
+     * a send. It still goes in turn with the order's other actions.
+     */
+    void defer(throttle_owner_t *owner, const zenfire::order_ptr &order, throttle_op_t op,
+        const std::string &reason = std::string());
+
+    /**
+     * {queued cancels, queued other actions, sent inline, sent from the
+     *  queue, queued actions that failed, mean and max queueing delay ns}
+     */
+    void stats(int64_t out[7]);
+};
+
+/** Never freed; its sender thread runs for the life of the process. */
+extern order_throttle_t &throttle;
+
+#endif
+
+//############################################################################//
@@ -0,0 +1,267 @@
+
+//############################################################################//
+
+/** \file trace.cpp
+ * \brief Per-thread event tracing, exported as Chrome trace JSON
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+// I N C L U D E S ###########################################################//
+
+#include "trace.hpp"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+volatile int trace_enabled = 0;
+
+// events per ring; a power of two
+static volatile uint32_t ring_events = 1024;
+
+/**
+ * seq is 2h+1 while slot h is written and 2h+2 once it is complete, as in
+ * the shm tick ring, so a dump can skip slots overwritten under it.
+ */
+struct trace_event {
+    volatile uint32_t seq;
+    const char *name;
+    int64_t begin;
+    int64_t end;
+};
+
+struct trace_ring {
+    int tid;
+    volatile uint32_t head;
+    // fixed when the ring is made; a recycled ring keeps its size
+    uint32_t size;
+    trace_event *events;
+
+    trace_ring(uint32_t size) : tid(0), head(0), size(size), events(new trace_event[size]) { }
+};
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+// never freed: a thread's events stay dumpable after it exits, until its
+// ring is handed to a new thread from free_rings
+static vector<trace_ring *> rings;
+static vector<trace_ring *> free_rings;
+static __thread trace_ring *my_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static volatile int armed = 0;
+static volatile int triggered = 0;
+// written only while disarmed
+static int64_t threshold_ns = 0;
+static string armed_path;
+
+int64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/** Thread exit: the ring goes back for the next thread that traces. */
+static void release_ring(void *r) {
+    my_ring = NULL;
+    pthread_mutex_lock(&rings_lock);
+    free_rings.push_back((trace_ring *) r);
+    pthread_mutex_unlock(&rings_lock);
+}
+
+static void make_ring_key() {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+/**
+ * The calling thread's ring, recycled from an exited thread if one is free,
+ * so threads that come and go while tracing is on do not add rings.
+ */
+static trace_ring *ring() {
+    if (my_ring == NULL) {
+        pthread_once(&ring_key_once, make_ring_key);
+
+        trace_ring *r = NULL;
+        pthread_mutex_lock(&rings_lock);
+        if (! free_rings.empty()) {
+            r = free_rings.back();
+            free_rings.pop_back();
+        }
+        pthread_mutex_unlock(&rings_lock);
+
+        bool fresh = r == NULL;
+        if (fresh) {
+            r = new trace_ring(ring_events);
+        }
+        // the previous thread's events would otherwise be dumped as ours
+        r->head = 0;
+        for (uint32_t i = 0; i < r->size; i ++) {
+            r->events[i].seq = 0;
+        }
+        __sync_synchronize();
+        r->tid = (int) syscall(SYS_gettid);
+        if (fresh) {
+            pthread_mutex_lock(&rings_lock);
+            rings.push_back(r);
+            pthread_mutex_unlock(&rings_lock);
+        }
+        pthread_setspecific(ring_key, r);
+        my_ring = r;
+    }
+    return my_ring;
+}
+
+static void *dump_triggered(void *) {
+    pthread_mutex_lock(&rings_lock);
+    string path = armed_path;
+    pthread_mutex_unlock(&rings_lock);
+    try {
+        trace_dump(path);
+    } catch (exception &) {
+        // nowhere to report it; the triggered count still moves
+    }
+    __sync_add_and_fetch(&triggered, 1);
+    return NULL;
+}
+
+static void trigger() {
+    if (! __sync_bool_compare_and_swap(&armed, 1, 0)) {
+        return;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    pthread_create(&thread, &attr, dump_triggered, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+void trace_record(const char *name, int64_t begin_ns, int64_t end_ns) {
+    trace_ring *r = ring();
+    uint32_t h = r->head;
+    trace_event &e = r->events[h & (r->size - 1)];
+
+    e.seq = 2 * h + 1;
+    __sync_synchronize();
+    e.name = name;
+    e.begin = begin_ns;
+    e.end = end_ns;
+    __sync_synchronize();
+    e.seq = 2 * h + 2;
+    r->head = h + 1;
+
+    if (armed && end_ns - begin_ns > threshold_ns) {
+        trigger();
+    }
+}
+
+long trace_dump(const string &path) {
+    pthread_mutex_lock(&rings_lock);
+    vector<trace_ring *> all(rings);
+    pthread_mutex_unlock(&rings_lock);
+
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == NULL) {
+        throw runtime_error("Failed to open " + path);
+    }
+
+    int pid = (int) getpid();
+    long written = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (size_t i = 0; i < all.size(); i ++) {
+        trace_ring *r = all[i];
+        uint32_t head = r->head;
+        uint32_t n = head < r->size ? head : r->size;
+        for (uint32_t h = head - n; h != head; h ++) {
+            const trace_event &e = r->events[h & (r->size - 1)];
+            uint32_t seq = e.seq;
+            if (seq != 2 * h + 2) continue;
+            __sync_synchronize();
+            const char *name = e.name;
+            int64_t begin = e.begin;
+            int64_t end = e.end;
+            __sync_synchronize();
+            if (e.seq != seq) continue;
+
+            fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"jzenfire\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                written == 0 ? "" : ",",
+                name, pid, r->tid,
+                begin / 1000.0, (end - begin) / 1000.0);
+            written ++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0 || failed) {
+        throw runtime_error("Failed to write " + path);
+    }
+    return written;
+}
+
+void trace_arm(const string &path, int64_t threshold_ns) {
+    armed = 0;
+    if (threshold_ns <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&rings_lock);
+    armed_path = path;
+    pthread_mutex_unlock(&rings_lock);
+    ::threshold_ns = threshold_ns;
+    __sync_synchronize();
+    armed = 1;
+}
+
+bool get_trace_option(const string &option, int &value) {
+    if (option == "jzenfire.trace") {
+        value = trace_enabled;
+    } else if (option == "jzenfire.trace.triggered") {
+        value = triggered;
+    } else if (option == "jzenfire.trace.ring_events") {
+        value = (int) ring_events;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool set_trace_option(const string &option, int value) {
+    if (option == "jzenfire.trace") {
+        trace_enabled = value ? 1 : 0;
+        return true;
+    } else if (option == "jzenfire.trace.ring_events") {
+        if (value < 16 || value > (1 << 20) || (value & (value - 1)) != 0) {
+            throw invalid_argument("jzenfire.trace.ring_events must be a power of two from 16 to 1048576");
+        }
+        ring_events = (uint32_t) value;
+        return true;
+    }
+    return false;
+}
+
+//############################################################################//
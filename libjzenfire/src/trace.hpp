@@ -0,0 +1,102 @@
+
+//############################################################################//
+
+/** \file trace.hpp
+ * \brief Per-thread event tracing, exported as Chrome trace JSON
+ */
+
+// L I C E N S E #############################################################//
+
+/*
+ *  Copyright 2009 BigWells Technology (Zen-Fire)
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef JZENFIRE_TRACE_HPP
+#define JZENFIRE_TRACE_HPP
+
+// I N C L U D E S ###########################################################//
+
+#include <stdint.h>
+
+#include <string>
+
+/** Whether scopes are recorded, process wide. */
+extern volatile int trace_enabled;
+
+/** Monotonic clock, nanoseconds. */
+int64_t trace_now();
+
+/**
+ * Records a completed scope into the calling thread's ring. Each thread
+ * writes only its own ring, so recording takes no lock; the oldest events
+ * are overwritten once the ring is full. A ring outlives its thread for
+ * dumps until another thread starts tracing and reuses it. name must be a
+ * string literal.
+ */
+void trace_record(const char *name, int64_t begin_ns, int64_t end_ns);
+
+/**
+ * Times the enclosing block when tracing is enabled. When it is not, the
+ * cost is one load and a branch on entry and on exit.
+ */
+class trace_scope {
+    private:
+    const char *name;
+    int64_t begin;
+
+    trace_scope(const trace_scope &);
+    trace_scope& operator=(const trace_scope &);
+
+    public:
+    trace_scope(const char *name) : name(name), begin(trace_enabled ? trace_now() : 0) { }
+
+    ~trace_scope() {
+        if (begin != 0) {
+            trace_record(name, begin, trace_now());
+        }
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+/**
+ * Writes every thread's ring to path as Chrome trace event JSON, which
+ * chrome://tracing and Perfetto open. Returns the number of events written.
+ */
+long trace_dump(const std::string &path);
+
+/**
+ * Arms a one-shot trigger: the first scope to take longer than threshold_ns
+ * has the rings dumped to path from a background thread. A threshold of 0
+ * disarms it.
+ */
+void trace_arm(const std::string &path, int64_t threshold_ns);
+
+/**
+ * Handles "jzenfire.trace" (0 or 1), "jzenfire.trace.triggered", the
+ * number of trigger dumps so far, and "jzenfire.trace.ring_events", the
+ * events each thread's ring holds (a power of two, 1024 by default), which
+ * applies to rings made after it is set. Returns false for options it does
+ * not know.
+ */
+bool get_trace_option(const std::string &option, int &value);
+bool set_trace_option(const std::string &option, int value);
+
+#endif
+
+//############################################################################//